@@ -8,6 +8,9 @@
  */
 
 #include <SoftwareSerial.h>
+#include <EEPROM.h>
+#include <avr/wdt.h>
+#include <util/crc16.h>
 
 // =======================================================
 // CONFIGURACIÓN XBEE Y SERIAL
@@ -79,6 +82,14 @@ unsigned long pulseCountPeriod = 0;
 // Envío cada 60 s
 const unsigned long PERIODO_ENVIO_MS = 60000UL;
 unsigned long ultimoEnvioMs = 0;
+unsigned long ultimoFinTxMs = 0;   // fin de la última transmisión (para el mute posterior)
+
+// Marcas de tiempo (millis al inicio) de los pulsos válidos del periodo.
+// Se envían a la base como edades relativas a S para el veto por
+// coincidencia entre nodos (EMI). Si se llenan, el resto solo se cuenta.
+const uint8_t MAX_TS_PULSOS = 16;
+unsigned long tsPulsos[MAX_TS_PULSOS];
+uint8_t       nTsPulsos = 0;
 
 // Ventana de silencio alrededor de la comunicación con XBee
 const unsigned long MUTE_COMMS_PRE_MS  = 50;
@@ -89,14 +100,238 @@ const unsigned long LED_PULSE_MS = 50;
 bool          ledOn          = false;
 unsigned long ledStartMs     = 0;
 
+// =======================================================
+// ARRANQUE, WATCHDOG Y ESTADO RETENIDO (igual que nodo 1)
+// =======================================================
+// Estado del detector en RAM .noinit (sobrevive al watchdog y al botón);
+// baseline y total también en EEPROM cada hora (sobreviven a un corte).
+// Requiere Optiboot: con el ATmegaBOOT antiguo el watchdog reinicia el nodo
+// en bucle dentro del cargador (ver nodo 1).
+const uint8_t       WDT_TIMEOUT          = WDTO_2S;
+const unsigned long ESTADO_CADA_MS       = 100;
+const uint8_t       EEPROM_CADA_REPORTES = 60;
+const uint16_t      ESTADO_MAGIC         = 0x5244;
+
+const int8_t        XBEE_CTS_PIN     = -1;   // CTS del XBee, -1 = sin cablear
+const unsigned long XBEE_ARRANQUE_MS = 500;  // espera tras encender sin CTS
+
+struct EstadoRetenido {
+  uint16_t      magic;
+  unsigned long guardadoMs;
+  float         baselineV;
+  unsigned long pulseCountTotal;
+  unsigned long pulseCountPeriod;
+  unsigned long ultimoEnvioMs;
+  unsigned long lastValidPulseMs;
+  unsigned long tsPulsos[MAX_TS_PULSOS];
+  uint8_t       nTsPulsos;
+  uint16_t      crc;
+};
+
+struct PuntoControl {
+  uint16_t      magic;
+  float         baselineV;
+  unsigned long pulseCountTotal;
+  uint16_t      crc;
+};
+
+EstadoRetenido estadoRam  __attribute__((section(".noinit")));
+uint8_t        causaReset __attribute__((section(".noinit")));
+
+char          origenEstado      = 'N';
+bool          helloPendiente    = true;
+unsigned long arranqueUs        = 0;
+unsigned long ultimoEstadoMs    = 0;
+uint8_t       reportesSinEeprom = 0;
+
+// =======================================================
+// CAPTURA DE FORMA DE ONDA (osciloscopio por radio)
+// =======================================================
+// Anillo de muestras crudas del ADC; al llegar un candidato se congela con
+// CAPTURE_PRE muestras previas y el resto posteriores, y se envía por XBee
+// en trozos cuando el nodo está en reposo. Ocupa 256 B de SRAM. Cada captura
+// cuesta ~1.1 s de tiempo muerto (ver nodo 1): como mucho una cada
+// CAPTURE_MIN_INTERVALO_MS.
+enum CaptureMode { CAP_OFF, CAP_CANDIDATOS, CAP_RECHAZADOS, CAP_CADA_N };
+const CaptureMode CAPTURE_MODE = CAP_OFF;  // CAP_OFF = sin capturas
+
+const unsigned long CAPTURE_PERIOD_US = 1000;  // 1 muestra por ms
+const uint8_t       CAPTURE_SAMPLES   = 128;   // 128 ms por captura
+const uint8_t       CAPTURE_PRE       = 32;    // muestras hasta el disparo (incluida)
+const uint8_t       CAPTURE_EVERY_N   = 20;    // solo para CAP_CADA_N
+const uint8_t       CAPTURE_CHUNK     = 16;    // muestras por mensaje
+const unsigned long CAPTURE_CHUNK_GAP_MS = 250;  // separación entre mensajes
+const unsigned long CAPTURE_TX_GUARD_MS  = 300;  // no enviar cerca del reporte
+const unsigned long CAPTURE_MIN_INTERVALO_MS = 60000;  // desde el fin de la anterior
+
+enum CapState { CS_ANILLO, CS_POST, CS_LISTA };
+CapState      capEstado        = CS_ANILLO;
+uint16_t      capBuf[CAPTURE_SAMPLES];
+uint8_t       capPos           = 0;    // próxima escritura en el anillo
+uint8_t       capPostRestantes = 0;
+unsigned long capUltimaUs      = 0;
+uint8_t       capId            = 0;
+uint8_t       capTrozo         = 0;    // 0 = cabecera, 1.. = datos
+char          capMotivo        = 0;    // 'V' válido, 'R' rechazado, 0 = sin clasificar
+uint16_t      capAmpMv         = 0;
+uint8_t       capDurMs         = 0;
+uint16_t      capCandidatos    = 0;
+unsigned long capUltimoTxMs    = 0;
+unsigned long capFinMs         = 0;    // fin del envío de la última captura
+
+// =======================================================
+// INSTRUMENTACIÓN DE LATENCIAS (opcional)
+// =======================================================
+// Con RADON_PROFILE = 1 se mide con Timer1 (0.5 us por tick) cuánto tarda
+// cada pasada del loop, la lectura + detección y cada transmisión XBee, en
+// histogramas log2 de memoria fija. Cada PROF_REPORTE_CADA reportes se
+// envían como "Nodo_2;P=<nombre>;M=<max_us>;H=<casilla>:<cuenta>,...",
+// donde la casilla k cubre [2^k, 2^(k+1)) ticks. Con 0 no se compila nada;
+// también se activa al compilar con -DRADON_PROFILE=1.
+#ifndef RADON_PROFILE
+#define RADON_PROFILE 0
+#endif
+
+#if RADON_PROFILE
+const uint8_t       PROF_CASILLAS       = 20;    // hasta ~0.5 s
+const uint8_t       PROF_REPORTE_CADA   = 10;    // reportes entre envíos
+const unsigned long PROF_PRESUPUESTO_US = 1000;  // periodo de muestreo objetivo
+
+struct HistLat {
+  uint16_t n[PROF_CASILLAS];
+  uint32_t maxTicks;
+};
+
+struct MarcaLat {
+  uint16_t      tcnt;
+  unsigned long ms;
+};
+
+HistLat  histLoop, histMuestreo, histTx;
+uint16_t profExcesos  = 0;   // pasadas del loop más largas que el presupuesto
+uint8_t  profReportes = 0;
+
+MarcaLat profMarca() {
+  MarcaLat m;
+  m.tcnt = TCNT1;
+  m.ms   = millis();
+  return m;
+}
+
+// Timer1 da la vuelta a los 32.7 ms; por encima se usa millis()
+uint32_t histAnotar(HistLat& h, const MarcaLat& m0) {
+  uint16_t      tcnt  = TCNT1;
+  unsigned long dms   = millis() - m0.ms;
+  uint32_t      ticks = (dms >= 30) ? dms * 2000UL : (uint16_t)(tcnt - m0.tcnt);
+
+  uint8_t  k = 0;
+  uint32_t t = ticks;
+  while (t > 1 && k < PROF_CASILLAS - 1) {
+    t >>= 1;
+    k++;
+  }
+  if (h.n[k] != 0xFFFF) h.n[k]++;
+  if (ticks > h.maxTicks) h.maxTicks = ticks;
+  return ticks;
+}
+
+#define PROF_INICIO(v)  MarcaLat v = profMarca()
+#define PROF_FIN(h, v)  histAnotar(h, v)
+#else
+#define PROF_INICIO(v)
+#define PROF_FIN(h, v)
+#endif
+
 // =======================================================
 // FUNCIONES AUXILIARES
 // =======================================================
 
-void registrarPulsoValido(unsigned long ahora) {
+// MCUSR (o r2 si Optiboot ya lo borró) antes del código en C
+#if defined(__AVR__)
+void leerCausaReset() __attribute__((naked, used, section(".init3")));
+void leerCausaReset() {
+  uint8_t r2;
+  __asm__ __volatile__("mov %0, r2" : "=r"(r2));
+  causaReset = MCUSR ? MCUSR : r2;
+  MCUSR = 0;
+  wdt_disable();
+}
+#endif
+
+uint16_t crcBloque(const void* p, size_t n) {
+  const uint8_t* b = (const uint8_t*)p;
+  uint16_t crc = 0xFFFF;
+  while (n--) crc = _crc16_update(crc, *b++);
+  return crc;
+}
+
+void guardarEstado(unsigned long ahora) {
+  estadoRam.magic            = ESTADO_MAGIC;
+  estadoRam.guardadoMs       = ahora;
+  estadoRam.baselineV        = baselineV;
+  estadoRam.pulseCountTotal  = pulseCountTotal;
+  estadoRam.pulseCountPeriod = pulseCountPeriod;
+  estadoRam.ultimoEnvioMs    = ultimoEnvioMs;
+  estadoRam.lastValidPulseMs = lastValidPulseMs;
+  memcpy(estadoRam.tsPulsos, tsPulsos, sizeof(tsPulsos));
+  estadoRam.nTsPulsos        = nTsPulsos;
+  estadoRam.crc = crcBloque(&estadoRam, offsetof(EstadoRetenido, crc));
+  ultimoEstadoMs = ahora;
+}
+
+void guardarPuntoControl() {
+  PuntoControl pc;
+  memset(&pc, 0, sizeof(pc));
+  pc.magic           = ESTADO_MAGIC;
+  pc.baselineV       = baselineV;
+  pc.pulseCountTotal = pulseCountTotal;
+  pc.crc = crcBloque(&pc, offsetof(PuntoControl, crc));
+  EEPROM.put(0, pc);
+}
+
+// Los tiempos retenidos se pasan al millis() nuevo (cero = reinicio)
+void restaurarEstado() {
+  if (!(causaReset & _BV(PORF)) && estadoRam.magic == ESTADO_MAGIC &&
+      estadoRam.crc == crcBloque(&estadoRam, offsetof(EstadoRetenido, crc))) {
+    unsigned long d = estadoRam.guardadoMs;
+    baselineV        = estadoRam.baselineV;
+    baselineInit     = true;
+    pulseCountTotal  = estadoRam.pulseCountTotal;
+    pulseCountPeriod = estadoRam.pulseCountPeriod;
+    ultimoEnvioMs    = estadoRam.ultimoEnvioMs - d;
+    lastValidPulseMs = estadoRam.lastValidPulseMs ? estadoRam.lastValidPulseMs - d : 0;
+    nTsPulsos        = min(estadoRam.nTsPulsos, MAX_TS_PULSOS);
+    for (uint8_t i = 0; i < nTsPulsos; i++) {
+      tsPulsos[i] = estadoRam.tsPulsos[i] - d;
+    }
+    origenEstado = 'R';
+    return;
+  }
+
+  PuntoControl pc;
+  EEPROM.get(0, pc);
+  if (pc.magic == ESTADO_MAGIC && pc.crc == crcBloque(&pc, offsetof(PuntoControl, crc))) {
+    baselineV       = pc.baselineV;
+    baselineInit    = true;
+    pulseCountTotal = pc.pulseCountTotal;
+    origenEstado    = 'E';
+  }
+}
+
+bool xbeeListo(unsigned long ahora) {
+  if (XBEE_CTS_PIN >= 0) return digitalRead(XBEE_CTS_PIN) == LOW;
+  if (causaReset != 0 && !(causaReset & (_BV(PORF) | _BV(BORF)))) return true;
+  return ahora >= XBEE_ARRANQUE_MS;
+}
+
+void registrarPulsoValido(unsigned long ahora, unsigned long inicioMs) {
   pulseCountTotal++;
   pulseCountPeriod++;
 
+  if (nTsPulsos < MAX_TS_PULSOS) {
+    tsPulsos[nTsPulsos++] = inicioMs;
+  }
+
   digitalWrite(LED_BUILTIN, HIGH);
   ledOn      = true;
   ledStartMs = ahora;
@@ -107,30 +342,195 @@ void registrarPulsoValido(unsigned long ahora) {
   Serial.println(pulseCountTotal);
 }
 
+// "Nodo_2;HELLO;R=<causa>;E=<estado>;B=<us>" (mismo formato que nodo 1)
+void imprimirHandshake(Print& out) {
+  out.print(F("Nodo_2;HELLO;R="));
+  if (causaReset & _BV(PORF))  out.print('P');
+  if (causaReset & _BV(EXTRF)) out.print('X');
+  if (causaReset & _BV(BORF))  out.print('B');
+  if (causaReset & _BV(WDRF))  out.print('W');
+  out.print(F(";E="));
+  out.print(origenEstado);
+  out.print(F(";B="));
+  out.println(arranqueUs);
+}
+
 void sendHandshake() {
-  String msg = "Nodo_2;HELLO";
-  xbeeSerial.println(msg);
+  imprimirHandshake(xbeeSerial);
 
+  Serial.println(F("Nodo radon NODO 2 iniciado (TP3 en A4, discriminacion en software)."));
   Serial.print(F("Handshake enviado desde Nodo 2 -> "));
-  Serial.println(msg);
+  imprimirHandshake(Serial);
+}
+
+// Reporte periódico: "Nodo_2;C=<cuentas>;S=<millis>;T=<edad>,<edad>,..."
+// S es el millis() del nodo al enviar y cada T es la edad en ms (S - inicio)
+// de un pulso válido; la base las usa para el veto por coincidencia.
+// Se imprime por partes para no armar un String largo en la SRAM del Nano.
+void imprimirReporte(Print& out, unsigned long delta, unsigned long ahora) {
+  out.print(F("Nodo_2;C="));
+  out.print(delta);
+  out.print(F(";S="));
+  out.print(ahora);
+  for (uint8_t i = 0; i < nTsPulsos; i++) {
+    out.print(i == 0 ? F(";T=") : F(","));
+    out.print(ahora - tsPulsos[i]);
+  }
+  out.println();
+}
+
+// -------------------------------------------------------
+// Captura de forma de onda
+// -------------------------------------------------------
+
+// Guarda una muestra cada CAPTURE_PERIOD_US mientras el anillo no está congelado
+void capturarMuestra(int raw) {
+  if (CAPTURE_MODE == CAP_OFF || capEstado == CS_LISTA) return;
+
+  unsigned long us = micros();
+  if (us - capUltimaUs < CAPTURE_PERIOD_US) return;
+  // Mantener la cadencia; si el loop se atrasó mucho, resincronizar
+  capUltimaUs = (us - capUltimaUs < 2 * CAPTURE_PERIOD_US) ? capUltimaUs + CAPTURE_PERIOD_US : us;
+
+  capBuf[capPos] = (uint16_t)raw;
+  capPos = (capPos + 1) % CAPTURE_SAMPLES;
+
+  if (capEstado == CS_POST && --capPostRestantes == 0) {
+    capEstado = CS_LISTA;  // capPos apunta ahora a la muestra más antigua
+    capTrozo  = 0;
+  }
+}
+
+// Llamada al iniciar un candidato de pulso
+void dispararCaptura() {
+  if (CAPTURE_MODE == CAP_OFF || capEstado != CS_ANILLO) return;
+  if (millis() - capFinMs < CAPTURE_MIN_INTERVALO_MS) return;
+  capCandidatos++;
+  if (CAPTURE_MODE == CAP_CADA_N && (capCandidatos % CAPTURE_EVERY_N) != 0) return;
+
+  capEstado        = CS_POST;
+  capPostRestantes = CAPTURE_SAMPLES - CAPTURE_PRE;
+  capMotivo        = 0;
+}
+
+// Llamada al clasificar el pulso que disparó la captura
+void clasificarCaptura(bool valido, float ampV, unsigned long durMs) {
+  if (capEstado == CS_ANILLO || capMotivo != 0) return;
+  if (CAPTURE_MODE == CAP_RECHAZADOS && valido) {
+    capEstado = CS_ANILLO;  // descartar, solo interesan los rechazados
+    return;
+  }
+  capMotivo = valido ? 'V' : 'R';
+  capAmpMv  = (uint16_t)(ampV * 1000.0);
+  capDurMs  = (durMs > 255) ? 255 : (uint8_t)durMs;
+}
+
+void imprimirHex3(Print& out, uint16_t v) {
+  const char* hex = "0123456789ABCDEF";
+  out.print(hex[(v >> 8) & 0xF]);
+  out.print(hex[(v >> 4) & 0xF]);
+  out.print(hex[v & 0xF]);
+}
+
+// Envía un trozo por XBee si el enlace está libre. Cabecera:
+//   "Nodo_2;W=<id>;H=<muestras>,<pre>,<periodo_us>,<V|R>,<amp_mV>,<dur_ms>"
+// y luego CAPTURE_SAMPLES / CAPTURE_CHUNK trozos:
+//   "Nodo_2;W=<id>;K=<trozo>;D=<3 hex por muestra>"
+bool enviarTrozoCaptura(unsigned long ahora) {
+  if (capEstado != CS_LISTA || capMotivo == 0) return false;
+  if (ahora - capUltimoTxMs < CAPTURE_CHUNK_GAP_MS) return false;
+  if (PERIODO_ENVIO_MS - (ahora - ultimoEnvioMs) < CAPTURE_TX_GUARD_MS) return false;
+
+  xbeeSerial.print(F("Nodo_2;W="));
+  xbeeSerial.print(capId);
+  if (capTrozo == 0) {
+    xbeeSerial.print(F(";H="));
+    xbeeSerial.print(CAPTURE_SAMPLES);
+    xbeeSerial.print(',');
+    xbeeSerial.print(CAPTURE_PRE);
+    xbeeSerial.print(',');
+    xbeeSerial.print(CAPTURE_PERIOD_US);
+    xbeeSerial.print(',');
+    xbeeSerial.print(capMotivo);
+    xbeeSerial.print(',');
+    xbeeSerial.print(capAmpMv);
+    xbeeSerial.print(',');
+    xbeeSerial.println(capDurMs);
+  } else {
+    xbeeSerial.print(F(";K="));
+    xbeeSerial.print(capTrozo);
+    xbeeSerial.print(F(";D="));
+    uint8_t base = (capTrozo - 1) * CAPTURE_CHUNK;
+    for (uint8_t i = 0; i < CAPTURE_CHUNK; i++) {
+      imprimirHex3(xbeeSerial, capBuf[(capPos + base + i) % CAPTURE_SAMPLES]);
+    }
+    xbeeSerial.println();
+  }
+  capUltimoTxMs = millis();
+
+  if (++capTrozo > CAPTURE_SAMPLES / CAPTURE_CHUNK) {
+    Serial.print(F("Captura enviada, id = "));
+    Serial.println(capId);
+    capId++;
+    capFinMs  = millis();
+    capEstado = CS_ANILLO;  // reanudar el anillo
+  }
+  return true;
+}
+
+#if RADON_PROFILE
+void enviarHistograma(Print& out, const char* nombre, HistLat& h) {
+  out.print(F("Nodo_2;P="));
+  out.print(nombre);
+  out.print(F(";M="));
+  out.print(h.maxTicks / 2);
+  if (&h == &histLoop) {
+    out.print(F(";E="));
+    out.print(profExcesos);
+    profExcesos = 0;
+  }
+  out.print(F(";H="));
+  bool primero = true;
+  for (uint8_t k = 0; k < PROF_CASILLAS; k++) {
+    if (h.n[k] == 0) continue;
+    if (!primero) out.print(',');
+    primero = false;
+    out.print(k);
+    out.print(':');
+    out.print(h.n[k]);
+  }
+  out.println();
+  memset(&h, 0, sizeof(h));
 }
 
+void enviarPerfil(Print& out) {
+  enviarHistograma(out, "loop", histLoop);
+  enviarHistograma(out, "muestreo", histMuestreo);
+  enviarHistograma(out, "tx", histTx);
+}
+#endif
+
 // =======================================================
 // SETUP
 // =======================================================
 
 void setup() {
+  wdt_enable(WDT_TIMEOUT);
+  restaurarEstado();
+
   Serial.begin(USB_BAUD);
   xbeeSerial.begin(XBEE_BAUD);
 
+#if RADON_PROFILE
+  TCCR1A = 0;
+  TCCR1B = _BV(CS11);  // Timer1 libre a 2 MHz (0.5 us por tick)
+#endif
+
   pinMode(TP3_PIN, INPUT);
   pinMode(LED_BUILTIN, OUTPUT);
   digitalWrite(LED_BUILTIN, LOW);
-
-  Serial.println(F("Nodo radon NODO 2 iniciado (TP3 en A4, discriminacion en software)."));
-
-  delay(500);
-  sendHandshake();
+  if (XBEE_CTS_PIN >= 0) pinMode(XBEE_CTS_PIN, INPUT);
+  // El handshake sale desde el loop cuando el XBee esté listo
 }
 
 // =======================================================
@@ -138,13 +538,15 @@ void setup() {
 // =======================================================
 
 void loop() {
+  PROF_INICIO(profLoop);
+  wdt_reset();
   unsigned long ahora = millis();
 
   // Ventana de silencio XBee
   unsigned long tiempoDesdeEnvio = ahora - ultimoEnvioMs;
   bool enVentanaMute = false;
 
-  if (tiempoDesdeEnvio <= MUTE_COMMS_POST_MS) {
+  if (ahora - ultimoFinTxMs <= MUTE_COMMS_POST_MS) {
     enVentanaMute = true;
   } else if (tiempoDesdeEnvio < PERIODO_ENVIO_MS &&
              (PERIODO_ENVIO_MS - tiempoDesdeEnvio) <= MUTE_COMMS_PRE_MS) {
@@ -152,8 +554,16 @@ void loop() {
   }
 
   // Lectura analógica
+  PROF_INICIO(profMuestreo);
   int   raw = analogRead(TP3_PIN);
   float v   = raw * ADC_LSB;
+  capturarMuestra(raw);
+
+  // Primera muestra: tiempo de arranque y validez de la baseline restaurada
+  if (arranqueUs == 0) {
+    arranqueUs = micros();
+    if (baselineInit && fabs(v - baselineV) >= MIN_DROP_V) baselineInit = false;
+  }
 
   if (!baselineInit) {
     baselineV    = v;
@@ -195,6 +605,7 @@ void loop() {
         pulseStartMs   = ahora;
         pulseStartBase = baselineV;
         pulseMinV      = v;
+        dispararCaptura();
       }
       break;
     }
@@ -246,8 +657,10 @@ void loop() {
         }
 
         if (valido && !burstBlocked) {
-          registrarPulsoValido(ahora);
+          registrarPulsoValido(ahora, pulseStartMs);
+          guardarEstado(ahora);
         }
+        clasificarCaptura(valido && !burstBlocked, ampV, durMs);
 
         pulseState   = PS_REFRACTORY;
         pulseStartMs = ahora;
@@ -263,24 +676,66 @@ void loop() {
     }
   }
 
+  PROF_FIN(histMuestreo, profMuestreo);
+
   // LED
   if (ledOn && (ahora - ledStartMs >= LED_PULSE_MS)) {
     digitalWrite(LED_BUILTIN, LOW);
     ledOn = false;
   }
 
+  // Handshake en cuanto el XBee esté listo
+  if (helloPendiente && xbeeListo(ahora)) {
+    helloPendiente = false;
+    sendHandshake();
+    ultimoFinTxMs = millis();
+  }
+
   // Envío periódico por XBee (cada 60 s)
-  if (ahora - ultimoEnvioMs >= PERIODO_ENVIO_MS) {
+  if (!helloPendiente && ahora - ultimoEnvioMs >= PERIODO_ENVIO_MS) {
     ultimoEnvioMs = ahora;
 
     unsigned long delta = pulseCountPeriod;
     pulseCountPeriod = 0;
 
-    String msg = "Nodo_2;C=" + String(delta);
-    xbeeSerial.println(msg);
+    PROF_INICIO(profTx);
+    imprimirReporte(xbeeSerial, delta, ahora);
+    PROF_FIN(histTx, profTx);
+#if RADON_PROFILE
+    if (++profReportes >= PROF_REPORTE_CADA) {
+      profReportes = 0;
+      enviarPerfil(xbeeSerial);
+    }
+#endif
+    if (++reportesSinEeprom >= EEPROM_CADA_REPORTES) {
+      reportesSinEeprom = 0;
+      guardarPuntoControl();  // dentro del silencio posterior
+    }
+    ultimoFinTxMs = millis();
 
     Serial.print(F("Enviado al XBee (Nodo 2) -> "));
-    Serial.println(msg);
+    imprimirReporte(Serial, delta, ahora);
+    nTsPulsos = 0;
+    guardarEstado(ahora);
+  }
+
+  // Capturas: solo con el detector en reposo
+  if (pulseState == PS_IDLE && !burstBlocked && !enVentanaMute) {
+    PROF_INICIO(profTrozo);
+    if (enviarTrozoCaptura(ahora)) {
+      PROF_FIN(histTx, profTrozo);
+      ultimoFinTxMs = millis();  // mismo silencio posterior que un reporte
+    }
+  }
+
+  if (ahora - ultimoEstadoMs >= ESTADO_CADA_MS) {
+    guardarEstado(ahora);
+  }
+
+#if RADON_PROFILE
+  if (PROF_FIN(histLoop, profLoop) > 2UL * PROF_PRESUPUESTO_US) {  // ticks de 0.5 us
+    profExcesos++;
   }
+#endif
 }
 
@@ -8,6 +8,10 @@
  */
 
 #include <Arduino.h>
+#include <LittleFS.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
 
 // =======================================================
 //   CONFIGURACIÓN XBEE / UART2
@@ -31,47 +35,1122 @@ const float S_act_cps_per_BqL = 0.43f;
 const unsigned long HEARTBEAT_INTERVAL_MS = 900000UL; // 15 * 60 * 1000
 
 // =======================================================
-//   ACUMULADORES DE CUENTAS EN LA VENTANA DE 1 HORA
+//   INSTRUMENTACIÓN DE LATENCIAS (opcional)
 // =======================================================
-unsigned long pulsesNode1Hour = 0;   // solo Nodo_1 en la hora
-unsigned long pulsesNode2Hour = 0;   // solo Nodo_2 en la hora
+// Con RADON_PROFILE = 1 se mide con el contador de ciclos del ESP32 (ccount)
+// la pasada del loop, el procesado de cada mensaje, la salida hacia el
+// Raspberry y el acceso a flash, en histogramas log2 de memoria fija
+// (casilla k = [2^k, 2^(k+1)) ciclos). Se vuelcan con el comando "PROF" y,
+// en modo binario, acompañan a las estadísticas. Con 0 no se compila nada;
+// también se activa al compilar con -DRADON_PROFILE=1.
+#ifndef RADON_PROFILE
+#define RADON_PROFILE 0
+#endif
+
+#if RADON_PROFILE
+const uint8_t PROF_CASILLAS = 32;
+
+struct HistLat {
+  uint32_t n[PROF_CASILLAS];
+  uint32_t maxCiclos;
+};
+
+HistLat histLoop, histParse, histTx, histFlash;
+
+uint32_t histAnotar(HistLat& h, uint32_t inicio) {
+  uint32_t ciclos = ESP.getCycleCount() - inicio;
+  uint8_t  k      = (ciclos == 0) ? 0 : 31 - __builtin_clz(ciclos);
+  h.n[k]++;
+  if (ciclos > h.maxCiclos) h.maxCiclos = ciclos;
+  return ciclos;
+}
+
+#define PROF_INICIO(v)  uint32_t v = ESP.getCycleCount()
+#define PROF_FIN(h, v)  histAnotar(h, v)
+#else
+#define PROF_INICIO(v)
+#define PROF_FIN(h, v)
+#endif
+
+// =======================================================
+//   VETO POR COINCIDENCIA ENTRE NODOS (EMI)
+// =======================================================
+// Una interferencia (motor, relé) produce pulsos falsos simultáneos en
+// varios nodos. Los nodos mandan la marca de tiempo de cada pulso válido y
+// aquí se fusionan en orden temporal en grupos de COINC_WINDOW_MS.
+//
+// Con muchos nodos o mucha actividad, dos alfas reales caen juntos por
+// casualidad a menudo, así que el número de nodos para vetar (k) sale de la
+// tasa de eventos de toda la red: con mu = tasa * ventana * (N-1)/N los
+// demás nodos vivos aportan un Poisson(mu) de eventos al grupo, y se veta
+// solo si P(k-1 o más) < COINC_ALFA, es decir, si el grupo es improbable
+// por azar. Con 2 nodos y radón normal k = 2; con cientos de nodos k sube
+// y solo se veta una EMI que alcance a muchos nodos a la vez.
+const unsigned long COINC_WINDOW_MS = 50;      // ventana de coincidencia
+const uint8_t       COINC_MIN_NODOS = 2;       // nunca se veta con menos
+const float         COINC_ALFA      = 0.01f;   // prob. de vetar un grupo casual
+const float         COINC_TASA_S    = 600.0f;  // memoria de la tasa de la red
+
+// Un nodo sin mensajes en este tiempo deja de frenar la fusión
+const unsigned long NODO_TIMEOUT_MS = 150000UL;      // 2.5 periodos de envío
+// Ningún evento espera más que esto a que los demás nodos reporten
+const unsigned long COINC_MAX_ESPERA_MS = 180000UL;
+
+// Compensación de la latencia del enlace. La línea cruza dos UART completas
+// (nodo -> su XBee a 9600 baudios y XBee coordinador -> base a XBEE_BAUD)
+// más el paquete de radio; lo que espere en el buffer del coordinador no se
+// puede saber y queda como error de la marca.
+const unsigned long NODO_US_POR_BYTE = 1042;                 // 9600 baudios, 8N1
+const unsigned long XBEE_US_POR_BYTE = 10000000UL / XBEE_BAUD;
+const unsigned long XBEE_AIRE_US     = 4000;                 // RF y reintentos típicos
+
+// =======================================================
+//   TABLA DE NODOS
+// =======================================================
+// El tamaño de la tabla se puede fijar al compilar (-DRADON_MAX_NODOS=256);
+// cada nodo ocupa ~170 B de RAM más 32 B en el reporte horario.
+#ifndef RADON_MAX_NODOS
+#define RADON_MAX_NODOS 32
+#endif
+const uint16_t MAX_NODOS    = RADON_MAX_NODOS;
+const uint8_t  COLA_EVENTOS = 32;   // eventos pendientes por nodo (potencia de 2)
+
+struct NodoEstado {
+  uint16_t      id;               // 0 = entrada libre
+  unsigned long ultimoMensajeMs;
+  unsigned long pulsosHora;       // cuentas aceptadas en la hora
+  unsigned long vetadosHora;      // cuentas vetadas por coincidencia en la hora
+  float         casualesHora;     // vetadas esperadas por azar en la hora
+
+  // Conversión reloj del nodo -> reloj de la base
+  bool          relojInit;
+  unsigned long ultimoS;          // millis() del nodo en el último reporte
+  unsigned long ultimoRxMs;       // millis() de la base al recibirlo (corregido)
+  float         tasaReloj;        // ms de base por ms de nodo
+  unsigned long marcaAguaMs;      // eventos anteriores a esto ya llegaron
+
+  // Cola ordenada de eventos pendientes (tiempo de la base)
+  unsigned long cola[COLA_EVENTOS];
+  uint8_t       colaIni;
+  uint8_t       colaN;
+};
+
+NodoEstado nodos[MAX_NODOS];
+
 unsigned long lastPublish     = 0;
 unsigned long msgCount        = 0;
 
+// Estadísticas del filtro de coincidencia (desde el arranque)
+unsigned long coincAceptados  = 0;
+unsigned long coincVetados    = 0;
+unsigned long coincDesbordes  = 0;   // eventos liberados sin poder comparar
+unsigned long coincTardios    = 0;   // llegaron con su grupo ya decidido
+float         coincCasuales   = 0;   // vetados esperados por azar
+
+// Tasa de eventos de la red (media exponencial en el reloj de los eventos)
+float         tasaEventos    = 0;   // eventos ponderados
+float         tasaTiempoS    = 0;   // segundos ponderados
+unsigned long tasaUltimoMs   = 0;
+bool          tasaInit       = false;
+
+// Fin de la ventana del último grupo decidido
+unsigned long decididoHastaMs = 0;
+bool          decididoInit    = false;
+
 // buffer para armar líneas desde Serial2
 String xbeeLine = "";
 
+// =======================================================
+//   REGISTRO EN FLASH (ALMACENAR Y REENVIAR)
+// =======================================================
+// Cada reporte horario se guarda, un registro por nodo, en un anillo de
+// segmentos en LittleFS (/radon/00000000.bin, ...). El número de secuencia
+// sirve de índice: seq-1 = segmento * LOG_REGS_POR_SEG + posición.
+// Al reconectarse, el Raspberry envía "SYNC <ultimo_seq> <hora_unix> <id_log>"
+// y la base le reenvía en binario todo lo posterior; "ACK <seq>" confirma el
+// seq más alto que el Raspberry recibió sin huecos.
+// El id del registro cambia cada vez que el anillo empieza de cero (flash
+// formateada o borrada), porque entonces los seq vuelven a empezar en 1.
+const char*    LOG_DIR          = "/radon";
+const char*    LOG_IDX_PATH     = "/radon.idx";
+const uint32_t LOG_REGS_POR_SEG = 1024;   // 32 KB por segmento
+const uint32_t LOG_SEGMENTOS    = 32;     // 1 MB en total (~32768 registros)
+
+const uint8_t       BACKFILL_LOTE           = 16;   // registros por trama
+const uint8_t       BACKFILL_VENTANA        = 8;    // tramas sin confirmar en vuelo
+const unsigned long BACKFILL_ACK_TIMEOUT_MS = 2000; // sin ACK: retransmitir
+const unsigned long LOG_IDX_MIN_MS          = 30000; // guardar ACK como mucho cada 30 s
+
+// Tramas binarias hacia el Raspberry: A5 5A | tipo | largo (LE16) | datos | CRC16
+const uint8_t TRAMA_SYNC0        = 0xA5;
+const uint8_t TRAMA_SYNC1        = 0x5A;
+const uint8_t TRAMA_REGISTROS    = 0x01;  // lote de RegistroRadon
+const uint8_t TRAMA_ESTADO_LOG   = 0x02;  // EstadoLog, en respuesta a SYNC
+
+struct __attribute__((packed)) RegistroRadon {
+  uint32_t seq;          // 1, 2, 3, ...
+  uint32_t unixTime;     // hora del Raspberry (0 = desconocida)
+  uint32_t uptimeS;      // segundos desde el arranque de la base
+  uint16_t boot;         // número de arranque de la base
+  uint16_t nodo;
+  uint32_t cuentas;      // cuentas aceptadas en la ventana
+  uint32_t vetadas;      // cuentas vetadas por coincidencia
+  float    actividad;    // Bq/m^3
+  uint16_t ventanaS;     // duración de la ventana
+  uint16_t crc;          // CRC-16/CCITT de los bytes anteriores
+};
+
+struct __attribute__((packed)) EstadoLog {
+  uint32_t primerSeq;    // registro más antiguo retenido
+  uint32_t ultimoSeq;    // registro más reciente
+  uint32_t uptimeS;
+  uint16_t boot;
+  uint32_t idLog;        // id del anillo al que pertenecen los seq
+};
+
+struct __attribute__((packed)) LogIndice {
+  uint32_t magic;
+  uint32_t confirmado;   // último seq confirmado por el Raspberry
+  uint16_t boot;
+  uint32_t idLog;
+  uint16_t crc;
+};
+const uint32_t LOG_MAGIC = 0x52444E32;  // "RDN2"
+
+bool          logOk        = false;
+uint32_t      logSegMin    = 0;    // segmento retenido más antiguo
+uint32_t      logSegActual = 0;
+uint32_t      logRegsEnSeg = 0;    // registros escritos en el segmento actual
+uint32_t      logConfirmado = 0;
+uint32_t      logId        = 0;
+uint16_t      bootCount    = 0;
+unsigned long logIdxGuardadoMs = 0;
+bool          logIdxPendiente  = false;
+
+// Hora unix del arranque (segundos), conocida tras el primer SYNC
+uint32_t unixArranqueS = 0;
+
+// Reenvío en curso
+bool          backfillActivo   = false;
+uint32_t      bfEnviado        = 0;   // último seq enviado
+unsigned long bfUltimoAvanceMs = 0;
+
+// Último seq de un reporte en vivo que salió entero por Serial
+uint32_t      vivoEnviado      = 0;
+
+// buffer para comandos del Raspberry por Serial
+String hostLine = "";
+
+// =======================================================
+//   SALIDA HACIA EL RASPBERRY PI: TEXTO O TRAMAS BINARIAS
+// =======================================================
+// En modo texto (por defecto) todo sale tal cual por Serial, como siempre.
+// Con "MODE BIN" del Raspberry, la salida son solo tramas:
+//   - reportes, eventos de pulso y estadísticas como registros binarios;
+//   - el texto de depuración y el eco del XBee en sus propios canales,
+//     agrupados hasta llenar la trama o durante CANAL_MAX_MS (una trama por
+//     byte o por pasada del loop gastaría más en cabeceras que en datos).
+const uint8_t TRAMA_REPORTE      = 0x03;  // reporte horario en vivo (RegistroRadon)
+const uint8_t TRAMA_EVENTOS      = 0x04;  // lote de EventoPulso
+const uint8_t TRAMA_ESTADISTICAS = 0x05;  // Estadisticas
+const uint8_t TRAMA_CAPTURA      = 0x06;  // trozo de captura de forma de onda (línea del nodo)
+const uint8_t TRAMA_PERFIL_NODO  = 0x07;  // línea "Nodo_X;P=..." de latencias del nodo
+const uint8_t TRAMA_PERFIL_BASE  = 0x08;  // PerfilBase (con RADON_PROFILE)
+const uint8_t TRAMA_REPORTE_SIGUE = 0x09; // parte de un reporte que sigue en la próxima trama
+const uint8_t TRAMA_TEXTO        = 0x10;  // texto de depuración
+const uint8_t TRAMA_ECO_XBEE     = 0x11;  // bytes crudos recibidos del XBee
+
+const uint8_t       EVENTOS_LOTE      = 32;     // eventos por trama
+const unsigned long EVENTOS_MAX_MS    = 1000;   // espera máxima para agrupar
+const unsigned long ESTADISTICAS_MS   = 60000;  // periodo de la trama de estadísticas
+const unsigned long CANAL_MAX_MS      = 100;    // espera máxima del texto y el eco
+
+struct __attribute__((packed)) EventoPulso {
+  uint32_t tBaseMs;      // inicio del pulso en el reloj de la base
+  uint16_t nodo;
+  uint8_t  vetado;       // 1 = vetado por coincidencia
+  uint8_t  nodosEnGrupo; // nodos con evento dentro de la ventana
+};
+
+struct __attribute__((packed)) Estadisticas {
+  uint32_t uptimeS;
+  uint32_t msgCount;
+  uint32_t coincAceptados;
+  uint32_t coincVetados;
+  uint32_t coincDesbordes;
+  uint32_t ultimoSeq;
+  uint32_t confirmado;
+  uint32_t heapLibre;
+  uint16_t nodosActivos;
+  uint16_t boot;
+  uint32_t coincCasuales;  // vetados esperados por azar (junto a coincVetados)
+  uint32_t coincTardios;
+  uint32_t tramasRechazadas;  // sin sitio en el buffer de Serial
+  uint32_t tramasGrandes;     // más largas que el buffer de tramas
+};
+
+struct __attribute__((packed)) PerfilBase {
+  uint8_t  id;           // 0 loop, 1 parse, 2 tx, 3 flash
+  uint8_t  casillas;
+  uint16_t cpuMhz;       // para pasar de ciclos a tiempo
+  uint32_t maxCiclos;
+  uint32_t n[32];
+};
+
+bool upstreamBinario = false;
+
+uint16_t crc16(const uint8_t* p, size_t n, uint16_t crc = 0xFFFF) {
+  while (n--) {
+    crc ^= (uint16_t)(*p++) << 8;
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+uint32_t tramasRechazadas = 0;
+uint32_t tramasGrandes    = 0;
+bool     lineaEnCurso     = false;  // modo texto: línea RADON_JSON a medio escribir
+
+// Escribe la trama completa de una vez para que no se mezcle con texto. Si
+// no cabe entera en el buffer de Serial no se escribe (el loop no puede
+// bloquearse) y devuelve false; quien deba reintentar mira antes el hueco.
+bool enviarTrama(uint8_t tipo, const uint8_t* datos, uint16_t largo) {
+  static uint8_t buf[5 + BACKFILL_LOTE * sizeof(RegistroRadon) + 2];
+  if (largo > sizeof(buf) - 7) {
+    tramasGrandes++;
+    return false;
+  }
+  if (lineaEnCurso || Serial.availableForWrite() < largo + 7) {
+    tramasRechazadas++;
+    return false;
+  }
+
+  PROF_INICIO(profTx);
+  buf[0] = TRAMA_SYNC0;
+  buf[1] = TRAMA_SYNC1;
+  buf[2] = tipo;
+  buf[3] = largo & 0xFF;
+  buf[4] = largo >> 8;
+  memcpy(buf + 5, datos, largo);
+  uint16_t crc = crc16(buf + 2, largo + 3);
+  buf[5 + largo] = crc & 0xFF;
+  buf[6 + largo] = crc >> 8;
+  Serial.write(buf, largo + 7);
+  PROF_FIN(histTx, profTx);
+  return true;
+}
+
+uint32_t bytesDescartados = 0;      // depuración que no cupo en el buffer de Serial
+
+// Print del texto de depuración y del eco del XBee. Acumula y sale por
+// líneas (modo texto) o como una trama cuando se llena o cuando el primer
+// byte pendiente cumple CANAL_MAX_MS (modo binario). Si no cabe en el buffer
+// de Serial se descarta: la depuración no puede bloquear el loop. En modo
+// binario el host puede apagarlo ("MODE BIN SIN_ECO SIN_DEPURACION").
+class CanalUpstream : public Print {
+ public:
+  explicit CanalUpstream(uint8_t tipo) : activo(true), tipo_(tipo), n_(0), primeroMs_(0) {}
+
+  bool activo;
+
+  size_t write(uint8_t c) override {
+    if (!activo) return 1;
+    if (n_ == 0) primeroMs_ = millis();
+    buf_[n_++] = c;
+    if (n_ == sizeof(buf_) || (c == '\n' && !upstreamBinario)) vaciar();
+    return 1;
+  }
+  using Print::write;
+
+  void vaciar() {
+    if (n_ == 0) return;
+    int hueco = upstreamBinario ? n_ + 7 : n_;
+    if (lineaEnCurso || Serial.availableForWrite() < hueco) {
+      bytesDescartados += n_;
+    } else if (upstreamBinario) {
+      enviarTrama(tipo_, buf_, n_);
+    } else {
+      Serial.write(buf_, n_);
+    }
+    n_ = 0;
+  }
+
+  void vaciarSiVence(unsigned long now) {
+    if (n_ > 0 && now - primeroMs_ >= CANAL_MAX_MS) vaciar();
+  }
+
+ private:
+  uint8_t       tipo_;
+  uint8_t       buf_[240];
+  uint16_t      n_;
+  unsigned long primeroMs_;
+};
+
+CanalUpstream Consola(TRAMA_TEXTO);
+CanalUpstream EcoXbee(TRAMA_ECO_XBEE);
+
+// Línea reenviada de un nodo en modo texto; igual que la depuración, si no
+// cabe entera se descarta
+void enviarLineaTexto(const char* prefijo, const String& msg) {
+  int largo = strlen(prefijo) + msg.length() + 2;
+  if (lineaEnCurso || Serial.availableForWrite() < largo) {
+    bytesDescartados += largo;
+    return;
+  }
+  Serial.print(prefijo);
+  Serial.println(msg);
+}
+
+EventoPulso   eventosLote[EVENTOS_LOTE];
+uint8_t       nEventosLote       = 0;
+unsigned long eventosPrimeroMs   = 0;
+unsigned long ultimasEstadMs     = 0;
+
+// procesarCoincidencias espera a que quepa; si aun así no cabe (cola llena
+// de un nodo, cambio de modo) el lote se pierde y queda en tramasRechazadas
+void vaciarEventos() {
+  if (nEventosLote == 0) return;
+  enviarTrama(TRAMA_EVENTOS, (const uint8_t*)eventosLote, nEventosLote * sizeof(EventoPulso));
+  nEventosLote = 0;
+}
+
+void anotarEvento(uint16_t nodo, unsigned long tBase, bool vetado, uint8_t nodosEnGrupo) {
+  if (!upstreamBinario) return;
+  if (nEventosLote == 0) eventosPrimeroMs = millis();
+  EventoPulso& e = eventosLote[nEventosLote++];
+  e.tBaseMs      = tBase;
+  e.nodo         = nodo;
+  e.vetado       = vetado ? 1 : 0;
+  e.nodosEnGrupo = nodosEnGrupo;
+  if (nEventosLote == EVENTOS_LOTE) vaciarEventos();
+}
+
+// =======================================================
+//   UTILIDADES DE TIEMPO Y TABLA DE NODOS
+// =======================================================
+
+// Comparación de millis() tolerante al desborde (~49 días)
+bool antesDe(unsigned long a, unsigned long b) {
+  return (long)(a - b) < 0;
+}
+
+// "Nodo_12" -> 12. Devuelve 0 si no hay número.
+uint16_t parseNodeId(const String& nodeId) {
+  int us = nodeId.lastIndexOf('_');
+  long id = nodeId.substring(us + 1).toInt();
+  if (id <= 0 || id > 65535) return 0;
+  return (uint16_t)id;
+}
+
+NodoEstado* buscarNodo(uint16_t id, bool crear) {
+  NodoEstado* libre = NULL;
+  for (uint16_t i = 0; i < MAX_NODOS; i++) {
+    if (nodos[i].id == id) return &nodos[i];
+    if (libre == NULL && nodos[i].id == 0) libre = &nodos[i];
+  }
+  if (!crear || libre == NULL) return NULL;
+
+  memset(libre, 0, sizeof(NodoEstado));
+  libre->id        = id;
+  libre->tasaReloj = 1.0f;
+  return libre;
+}
+
+float actividadBqm3(unsigned long cuentas) {
+  return (float)cuentas * 1000.0f / (T_WINDOW_SEC * S_act_cps_per_BqL);
+}
+
+// =======================================================
+//   FILTRO DE COINCIDENCIA EN FLUJO
+// =======================================================
+
+// Ajusta la conversión de reloj del nodo con cada reporte "S=".
+// La tasa corrige la deriva del resonador del Nano (hasta ~0.5 %).
+void actualizarReloj(NodoEstado& n, unsigned long sNodo, unsigned long rxMs) {
+  if (n.relojInit && (long)(sNodo - n.ultimoS) > 0) {
+    float r = (float)(rxMs - n.ultimoRxMs) / (float)(sNodo - n.ultimoS);
+    if (r > 0.98f && r < 1.02f) {
+      n.tasaReloj += 0.2f * (r - n.tasaReloj);
+    }
+  } else {
+    n.tasaReloj = 1.0f;  // primer reporte o el nodo se reinició
+  }
+  n.relojInit  = true;
+  n.ultimoS    = sNodo;
+  n.ultimoRxMs = rxMs;
+}
+
+void liberarEvento(NodoEstado& n, bool vetado, uint8_t nodosEnGrupo, float casuales = 0) {
+  anotarEvento(n.id, n.cola[n.colaIni], vetado, nodosEnGrupo);
+  n.casualesHora += casuales;
+  coincCasuales  += casuales;
+  n.colaIni = (n.colaIni + 1) & (COLA_EVENTOS - 1);
+  n.colaN--;
+  if (vetado) {
+    n.vetadosHora++;
+    coincVetados++;
+  } else {
+    n.pulsosHora++;
+    coincAceptados++;
+  }
+}
+
+void encolarEvento(NodoEstado& n, unsigned long tBase) {
+  if (decididoInit && !antesDe(decididoHastaMs, tBase)) {
+    // Su grupo ya se decidió sin él: se acepta sin comparar
+    anotarEvento(n.id, tBase, false, 0);
+    n.pulsosHora++;
+    coincAceptados++;
+    coincTardios++;
+    return;
+  }
+  if (n.colaN == COLA_EVENTOS) {
+    // Cola llena: el más antiguo se acepta sin comparar (memoria acotada)
+    liberarEvento(n, false, 0);
+    coincDesbordes++;
+  }
+  if (n.colaN > 0) {
+    unsigned long ultimo = n.cola[(n.colaIni + n.colaN - 1) & (COLA_EVENTOS - 1)];
+    if (antesDe(tBase, ultimo)) tBase = ultimo;  // mantener la cola ordenada
+  }
+  n.cola[(n.colaIni + n.colaN) & (COLA_EVENTOS - 1)] = tBase;
+  n.colaN++;
+}
+
+// Cada grupo decidido alimenta la tasa de la red con sus eventos
+void anotarTasa(unsigned long t, uint16_t eventos) {
+  if (tasaInit) {
+    float dt = (float)(long)(t - tasaUltimoMs) / 1000.0f;
+    float d  = expf(-(dt > 0 ? dt : 0) / COINC_TASA_S);
+    tasaEventos = tasaEventos * d + eventos;
+    tasaTiempoS = tasaTiempoS * d + COINC_TASA_S * (1.0f - d);
+  } else {
+    tasaEventos = eventos;
+    tasaInit    = true;
+  }
+  tasaUltimoMs = t;
+}
+
+// Nodos necesarios para vetar con 'vivos' nodos reportando. En casuales deja
+// cuántas cuentas reales se espera vetar por azar en cada grupo, E[(X+1) si
+// X >= k-1]. Mientras no haya un minuto de historia no se veta nada.
+// El umbral es de toda la red: con cientos de nodos sube a 5-6 y una EMI
+// local que ve 2 o 3 nodos ya no se veta, mientras lo vetado por azar
+// domina (ver README, "Límite con muchos nodos").
+uint16_t umbralCoincidencia(uint16_t vivos, float& casuales) {
+  casuales = 0;
+  if (vivos < COINC_MIN_NODOS || tasaTiempoS < 60.0f) return UINT16_MAX;
+
+  float mu    = tasaEventos / tasaTiempoS * (COINC_WINDOW_MS / 1000.0f) * (vivos - 1) / vivos;
+  float pj    = expf(-mu);   // P(X = j)
+  float cola  = 1.0f;        // P(X >= j)
+  float media = 1.0f + mu;   // E[(X+1) si X >= j]
+  uint16_t k = 1;
+  for (uint16_t j = 0; j < vivos; j++) {
+    if (k >= COINC_MIN_NODOS && cola < COINC_ALFA) {
+      casuales = media > 0 ? media : 0;
+      return k;
+    }
+    cola  -= pj;
+    media -= (j + 1) * pj;
+    pj    *= mu / (j + 1);
+    k++;
+  }
+  return UINT16_MAX;  // ni con todos los nodos sería significativo
+}
+
+// Fusión ordenada de las colas de todos los nodos. Un evento solo se decide
+// cuando todos los nodos activos ya reportaron más allá de su ventana
+// (marca de agua), así que cada grupo se evalúa una sola vez. El costo por
+// grupo es O(MAX_NODOS) y la memoria es fija (COLA_EVENTOS por nodo).
+void procesarCoincidencias(unsigned long now) {
+  unsigned long marca = now;
+  uint16_t      vivos = 0;
+  for (uint16_t i = 0; i < MAX_NODOS; i++) {
+    const NodoEstado& n = nodos[i];
+    if (n.id == 0 || !n.relojInit) continue;
+    if (now - n.ultimoMensajeMs >= NODO_TIMEOUT_MS) continue;
+    vivos++;
+    if (antesDe(n.marcaAguaMs, marca)) marca = n.marcaAguaMs;
+  }
+  if (antesDe(marca, now - COINC_MAX_ESPERA_MS)) {
+    marca = now - COINC_MAX_ESPERA_MS;
+  }
+
+  float    casuales;
+  uint16_t k = umbralCoincidencia(vivos, casuales);
+
+  for (;;) {
+    int           iMin = -1;
+    unsigned long tMin = 0;
+    for (uint16_t i = 0; i < MAX_NODOS; i++) {
+      if (nodos[i].colaN == 0) continue;
+      unsigned long t = nodos[i].cola[nodos[i].colaIni];
+      if (iMin < 0 || antesDe(t, tMin)) {
+        iMin = i;
+        tMin = t;
+      }
+    }
+    if (iMin < 0) return;
+
+    unsigned long finVentana = tMin + COINC_WINDOW_MS;
+    if (antesDe(marca, finVentana)) return;  // otro nodo aún podría coincidir
+    // Al volver un nodo callado se liberan decenas de segundos de la red de
+    // golpe: si el lote de eventos no cabría en Serial, el resto espera en
+    // las colas a la pasada siguiente en vez de perderse
+    if (upstreamBinario && Serial.availableForWrite() < (int)(7 + sizeof(eventosLote))) return;
+
+    uint16_t nodosEnGrupo = 0;
+    uint16_t eventos      = 0;
+    for (uint16_t i = 0; i < MAX_NODOS; i++) {
+      const NodoEstado& n = nodos[i];
+      uint8_t j = 0;
+      while (j < n.colaN && !antesDe(finVentana, n.cola[(n.colaIni + j) & (COLA_EVENTOS - 1)])) j++;
+      if (j > 0) nodosEnGrupo++;
+      eventos += j;
+    }
+    bool    veto  = (nodosEnGrupo >= k);
+    uint8_t grupo = (nodosEnGrupo < 255) ? nodosEnGrupo : 255;
+
+    // Lo esperado por azar se reparte entre los eventos del grupo
+    for (uint16_t i = 0; i < MAX_NODOS; i++) {
+      NodoEstado& n = nodos[i];
+      while (n.colaN > 0 && !antesDe(finVentana, n.cola[n.colaIni])) {
+        liberarEvento(n, veto, grupo, casuales / eventos);
+      }
+    }
+    anotarTasa(tMin, eventos);
+    decididoHastaMs = finVentana;
+    decididoInit    = true;
+
+    if (veto) {
+      Consola.print("[COINC] Veto EMI: evento simultaneo en ");
+      Consola.print(nodosEnGrupo);
+      Consola.print(" nodos (umbral ");
+      Consola.print(k);
+      Consola.println(").");
+    }
+  }
+}
+
+// =======================================================
+//   REGISTRO EN FLASH: ESCRITURA, LECTURA E ÍNDICE
+// =======================================================
+
+String rutaSegmento(uint32_t seg) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%s/%08u.bin", LOG_DIR, (unsigned)seg);
+  return String(buf);
+}
+
+uint32_t logUltimoSeq() {
+  return logSegActual * LOG_REGS_POR_SEG + logRegsEnSeg;
+}
+
+uint32_t logPrimerSeq() {
+  return logSegMin * LOG_REGS_POR_SEG + 1;
+}
+
+void guardarIndiceLog() {
+  LogIndice idx;
+  idx.magic      = LOG_MAGIC;
+  idx.confirmado = logConfirmado;
+  idx.boot       = bootCount;
+  idx.idLog      = logId;
+  idx.crc        = crc16((const uint8_t*)&idx, sizeof(idx) - 2);
+
+  File f = LittleFS.open(LOG_IDX_PATH, "w");
+  if (f) {
+    f.write((const uint8_t*)&idx, sizeof(idx));
+    f.close();
+  }
+  logIdxGuardadoMs = millis();
+  logIdxPendiente  = false;
+}
+
+// Monta LittleFS, recupera índice y cabeza del anillo
+void iniciarLogFlash() {
+  if (!LittleFS.begin(true)) {
+    Consola.println("[LOG] No se pudo montar LittleFS: registro en flash desactivado.");
+    return;
+  }
+
+  LogIndice idx;
+  File fi = LittleFS.open(LOG_IDX_PATH, "r");
+  if (fi && fi.read((uint8_t*)&idx, sizeof(idx)) == sizeof(idx) &&
+      idx.magic == LOG_MAGIC &&
+      idx.crc == crc16((const uint8_t*)&idx, sizeof(idx) - 2)) {
+    logConfirmado = idx.confirmado;
+    bootCount     = idx.boot;
+    logId         = idx.idLog;
+  }
+  if (fi) fi.close();
+  bootCount++;
+
+  if (!LittleFS.exists(LOG_DIR)) {
+    LittleFS.mkdir(LOG_DIR);
+  }
+
+  // La cabeza es el segmento de mayor número; no hace falta otro índice
+  bool hay = false;
+  uint32_t segMax = 0, segMin = 0;
+  File dir = LittleFS.open(LOG_DIR);
+  File f = dir.openNextFile();
+  while (f) {
+    const char* nombre = f.name();
+    const char* barra  = strrchr(nombre, '/');
+    uint32_t seg = strtoul(barra ? barra + 1 : nombre, NULL, 10);
+    if (!hay || seg > segMax) segMax = seg;
+    if (!hay || seg < segMin) segMin = seg;
+    hay = true;
+    f.close();
+    f = dir.openNextFile();
+  }
+  dir.close();
+
+  // Anillo vacío (o sin índice): los seq empiezan de nuevo, así que el
+  // Raspberry debe descartar el último seq que tenga de otro registro
+  if (!hay || logId == 0) {
+    logId         = (uint32_t)random(1, 0x7FFFFFFF);  // esp_random() en el ESP32
+    logConfirmado = 0;
+  }
+
+  if (hay) {
+    logSegMin    = segMin;
+    logSegActual = segMax;
+    File fs = LittleFS.open(rutaSegmento(segMax), "r");
+    size_t tam = fs ? fs.size() : 0;
+    if (fs) fs.close();
+    logRegsEnSeg = tam / sizeof(RegistroRadon);
+    if (tam % sizeof(RegistroRadon) != 0 || logRegsEnSeg >= LOG_REGS_POR_SEG) {
+      // Registro a medias (corte de energía) o segmento lleno: seguir en uno nuevo
+      logSegActual++;
+      logRegsEnSeg = 0;
+    }
+  }
+
+  logOk = true;
+  guardarIndiceLog();
+
+  Consola.print("[LOG] Registro en flash listo: seq ");
+  Consola.print(hay ? logPrimerSeq() : 0);
+  Consola.print(" .. ");
+  Consola.print(logUltimoSeq());
+  Consola.print(", confirmado = ");
+  Consola.print(logConfirmado);
+  Consola.print(", arranque #");
+  Consola.print(bootCount);
+  Consola.print(", id ");
+  Consola.println(logId);
+}
+
+// Añade un registro al final del anillo. 'f' es el segmento actual abierto
+// para añadir: se abre aquí si hace falta y queda abierto para el siguiente
+// registro del mismo reporte (abrir y cerrar por registro son ~3 ms, 1.7 s
+// con 512 nodos). Devuelve su seq (0 si falla).
+uint32_t registrarEnFlash(RegistroRadon& r, File& f) {
+  if (!logOk) return 0;
+
+  if (logRegsEnSeg >= LOG_REGS_POR_SEG) {
+    if (f) f.close();
+    logSegActual++;
+    logRegsEnSeg = 0;
+  }
+  // Mantener como mucho LOG_SEGMENTOS: borrar el más antiguo
+  while (logSegActual - logSegMin >= LOG_SEGMENTOS) {
+    LittleFS.remove(rutaSegmento(logSegMin));
+    logSegMin++;
+  }
+
+  r.seq = logSegActual * LOG_REGS_POR_SEG + logRegsEnSeg + 1;
+  r.crc = crc16((const uint8_t*)&r, sizeof(r) - 2);
+
+  if (!f) f = LittleFS.open(rutaSegmento(logSegActual), "a");
+  if (!f || f.write((const uint8_t*)&r, sizeof(r)) != sizeof(r)) {
+    if (f) f.close();
+    Consola.println("[LOG] Error al escribir en flash.");
+    return 0;
+  }
+  logRegsEnSeg++;
+  return r.seq;
+}
+
+// Lee hasta 'max' registros consecutivos desde 'desde' dentro de un mismo
+// segmento. Devuelve cuántos leyó (0 si el segmento no los tiene).
+uint8_t leerLoteFlash(uint32_t desde, RegistroRadon* buf, uint8_t max) {
+  uint32_t seg = (desde - 1) / LOG_REGS_POR_SEG;
+  uint32_t pos = (desde - 1) % LOG_REGS_POR_SEG;
+
+  File f = LittleFS.open(rutaSegmento(seg), "r");
+  if (!f) return 0;
+  uint8_t n = 0;
+  if (f.seek(pos * sizeof(RegistroRadon))) {
+    while (n < max && pos + n < LOG_REGS_POR_SEG &&
+           f.read((uint8_t*)&buf[n], sizeof(RegistroRadon)) == sizeof(RegistroRadon)) {
+      n++;
+    }
+  }
+  f.close();
+  return n;
+}
+
+// =======================================================
+//   REENVÍO DEL HISTORIAL AL RASPBERRY PI
+// =======================================================
+
+// primerSeq: nada anterior se va a reenviar (lo más antiguo retenido, o el
+// final de un hueco del registro)
+bool enviarEstadoLog(uint32_t primerSeq) {
+  EstadoLog e;
+  e.primerSeq = primerSeq;
+  e.ultimoSeq = logUltimoSeq();
+  e.uptimeS   = millis() / 1000;
+  e.boot      = bootCount;
+  e.idLog     = logId;
+  return enviarTrama(TRAMA_ESTADO_LOG, (const uint8_t*)&e, sizeof(e));
+}
+
+// Un lote por llamada y solo si cabe entero en el buffer de salida, para no
+// bloquear la lectura del XBee mientras se vacía el historial.
+void procesarBackfill(unsigned long now) {
+  if (!backfillActivo) return;
+
+  if (logConfirmado >= logUltimoSeq()) {
+    backfillActivo = false;
+    Consola.println("[LOG] Reenvío completado.");
+    guardarIndiceLog();
+    return;
+  }
+
+  if (now - bfUltimoAvanceMs >= BACKFILL_ACK_TIMEOUT_MS) {
+    bfEnviado        = logConfirmado;  // sin ACK: volver a lo confirmado
+    bfUltimoAvanceMs = now;
+  }
+
+  if (bfEnviado >= logUltimoSeq()) return;
+  if (bfEnviado - logConfirmado >= (uint32_t)BACKFILL_VENTANA * BACKFILL_LOTE) return;
+  if (Serial.availableForWrite() < (int)(7 + BACKFILL_LOTE * sizeof(RegistroRadon))) return;
+
+  uint32_t desde = bfEnviado + 1;
+  if (desde < logPrimerSeq()) desde = logPrimerSeq();  // lo anterior ya se borró
+
+  RegistroRadon lote[BACKFILL_LOTE];
+  PROF_INICIO(profFlash);
+  uint8_t n = leerLoteFlash(desde, lote, BACKFILL_LOTE);
+  PROF_FIN(histFlash, profFlash);
+  if (n == 0) {
+    // Hueco (segmento cerrado tras un corte): seguir en el siguiente segmento
+    desde = ((desde - 1) / LOG_REGS_POR_SEG + 1) * LOG_REGS_POR_SEG + 1;
+  }
+  if (desde > bfEnviado + 1) {
+    // Seq que no existen: el Raspberry no confirma más allá de un hueco, así
+    // que se le avisa con EstadoLog. Solo con todo lo anterior confirmado,
+    // porque el aviso taparía también una trama perdida antes del hueco.
+    if (logConfirmado < bfEnviado) return;
+    uint32_t hasta = min(desde - 1, logUltimoSeq());
+    if (enviarEstadoLog(hasta + 1)) bfEnviado = hasta;
+    return;
+  }
+  if (!enviarTrama(TRAMA_REGISTROS, (const uint8_t*)lote, n * sizeof(RegistroRadon))) return;
+  bfEnviado = lote[n - 1].seq;
+}
+
+// =======================================================
+//   REPORTE HORARIO PENDIENTE DE ENVÍO
+// =======================================================
+// Registros del último reporte horario (también se mandan en modo binario)
+RegistroRadon reporteActual[MAX_NODOS];
+uint16_t      nReporteActual = 0;
+
+// Con cientos de nodos el reporte tarda segundos a 115200 baudios, así que
+// sale a medida que hay sitio en el buffer de Serial (enviarReportePendiente
+// en cada pasada del loop). Mientras la línea RADON_JSON está a medio
+// escribir, el texto de depuración se descarta para no partirla.
+String   jsonPendiente  = "";
+uint32_t jsonEnviado    = 0;
+uint16_t reporteEnviado = 0;  // registros de reporteActual ya enviados
+uint32_t seqReporte     = 0;  // último seq en flash del reporte
+
+void enviarReportePendiente() {
+  while (reporteEnviado < nReporteActual) {
+    uint8_t n = min((int)BACKFILL_LOTE, (int)(nReporteActual - reporteEnviado));
+    if (Serial.availableForWrite() < (int)(7 + n * sizeof(RegistroRadon))) return;
+    uint8_t tipo = (reporteEnviado + n < nReporteActual) ? TRAMA_REPORTE_SIGUE : TRAMA_REPORTE;
+    if (!enviarTrama(tipo, (const uint8_t*)&reporteActual[reporteEnviado], n * sizeof(RegistroRadon))) return;
+    reporteEnviado += n;
+    if (reporteEnviado == nReporteActual && seqReporte != 0) vivoEnviado = seqReporte;
+  }
+
+  while (jsonEnviado < jsonPendiente.length()) {
+    int hueco = Serial.availableForWrite();
+    if (hueco <= 0) return;
+    uint32_t n = min((uint32_t)hueco, (uint32_t)(jsonPendiente.length() - jsonEnviado));
+    PROF_INICIO(profTx);
+    Serial.write((const uint8_t*)jsonPendiente.c_str() + jsonEnviado, n);
+    PROF_FIN(histTx, profTx);
+    jsonEnviado += n;
+  }
+  if (lineaEnCurso) {
+    lineaEnCurso  = false;
+    jsonPendiente = String();  // libera el buffer hasta el próximo reporte
+    jsonEnviado   = 0;
+    if (seqReporte != 0) vivoEnviado = seqReporte;
+  }
+}
+
+// Al cambiar de modo lo que falte del reporte ya no sirve (está en flash)
+void cancelarReportePendiente() {
+  if (lineaEnCurso) Serial.println();
+  lineaEnCurso   = false;
+  jsonPendiente  = String();
+  jsonEnviado    = 0;
+  reporteEnviado = nReporteActual;
+}
+
+#if RADON_PROFILE
+const char* const NOMBRES_PERFIL[] = { "loop", "parse", "tx", "flash" };
+HistLat* const    HISTS_PERFIL[]   = { &histLoop, &histParse, &histTx, &histFlash };
+
+// Volcado legible por el canal de depuración ("PROF")
+void imprimirPerfil() {
+  uint32_t mhz = getCpuFrequencyMhz();
+  for (uint8_t i = 0; i < 4; i++) {
+    const HistLat& h = *HISTS_PERFIL[i];
+    Consola.print("[PROF] ");
+    Consola.print(NOMBRES_PERFIL[i]);
+    Consola.print(": max = ");
+    Consola.print(h.maxCiclos / mhz);
+    Consola.print(" us |");
+    for (uint8_t k = 0; k < PROF_CASILLAS; k++) {
+      if (h.n[k] == 0) continue;
+      Consola.print(" >=");
+      Consola.print((1UL << k) / mhz);
+      Consola.print("us:");
+      Consola.print(h.n[k]);
+    }
+    Consola.println();
+  }
+}
+
+void enviarPerfilBase() {
+  PerfilBase pb;
+  for (uint8_t i = 0; i < 4; i++) {
+    pb.id        = i;
+    pb.casillas  = PROF_CASILLAS;
+    pb.cpuMhz    = getCpuFrequencyMhz();
+    pb.maxCiclos = HISTS_PERFIL[i]->maxCiclos;
+    memcpy(pb.n, HISTS_PERFIL[i]->n, sizeof(pb.n));
+    enviarTrama(TRAMA_PERFIL_BASE, (const uint8_t*)&pb, sizeof(pb));
+  }
+}
+#endif
+
+// Comandos del Raspberry: "SYNC <ultimo_seq> <hora_unix> [<id_log>]" y "ACK <seq>"
+void processHostCommand(const String& cmd) {
+  if (cmd.startsWith("SYNC")) {
+    const char* p = cmd.c_str() + 4;
+    char* fin;
+    uint32_t ultimo = strtoul(p, &fin, 10);
+    uint32_t unixS  = strtoul(fin, &fin, 10);
+    uint32_t idPi   = strtoul(fin, NULL, 10);  // 0 = no lo sabe
+    if (unixS > 0) unixArranqueS = unixS - millis() / 1000;
+
+    // Un seq de otro registro (flash formateada o borrada) no vale aquí:
+    // se reenvía todo. El Raspberry hace lo mismo al ver el id en EstadoLog.
+    if ((idPi != 0 && idPi != logId) || ultimo > logUltimoSeq()) {
+      ultimo = 0;
+    }
+
+    logConfirmado    = ultimo;  // el Raspberry sabe qué tiene
+    bfEnviado        = ultimo;
+    bfUltimoAvanceMs = millis();
+    backfillActivo   = logOk;
+    logIdxPendiente  = true;
+    enviarEstadoLog((logUltimoSeq() > 0) ? logPrimerSeq() : 0);
+
+    Consola.print("[LOG] SYNC del Raspberry: reenviando desde seq ");
+    Consola.print(ultimo + 1);
+    Consola.print(" hasta ");
+    Consola.println(logUltimoSeq());
+  } else if (cmd.startsWith("PROF")) {
+#if RADON_PROFILE
+    if (cmd.indexOf("RESET") >= 0) {
+      for (uint8_t i = 0; i < 4; i++) memset(HISTS_PERFIL[i], 0, sizeof(HistLat));
+    } else {
+      imprimirPerfil();
+    }
+#else
+    Consola.println("[PROF] Compilado sin RADON_PROFILE.");
+#endif
+  } else if (cmd.startsWith("MODE")) {
+    // "MODE BIN [SIN_ECO] [SIN_DEPURACION]": el eco del XBee y el texto de
+    // depuración son la mayor parte del tráfico USB y el host puede no
+    // usarlos. En modo texto salen siempre (son la salida misma).
+    bool bin = (cmd.indexOf("BIN") >= 0);
+    if (bin != upstreamBinario) {
+      Consola.vaciar();
+      EcoXbee.vaciar();
+      vaciarEventos();
+      cancelarReportePendiente();
+      upstreamBinario = bin;
+      Consola.activo  = true;
+      Consola.print("[UPSTREAM] Modo ");
+      Consola.println(bin ? "binario" : "texto");
+    }
+    EcoXbee.activo = !(bin && cmd.indexOf("SIN_ECO") >= 0);
+    Consola.activo = !(bin && cmd.indexOf("SIN_DEPURACION") >= 0);
+    if (!EcoXbee.activo) EcoXbee.vaciar();
+    if (!Consola.activo) Consola.vaciar();
+  } else if (cmd.startsWith("ACK")) {
+    uint32_t seq = strtoul(cmd.c_str() + 3, NULL, 10);
+    // Solo cuenta lo ya enviado: durante el reenvío, hasta bfEnviado; fuera
+    // de él, hasta el último reporte en vivo completo. Un ACK más alto se
+    // saltaría registros que el Raspberry no pudo recibir.
+    uint32_t tope = backfillActivo ? bfEnviado : vivoEnviado;
+    if (seq > tope) return;
+    if (seq > logConfirmado) {
+      logConfirmado    = seq;
+      bfUltimoAvanceMs = millis();
+      logIdxPendiente  = true;
+    }
+    // El Raspberry confirma sin huecos: si no llega al último reporte en
+    // vivo, perdió una trama y se reenvía desde lo confirmado
+    if (!backfillActivo && logOk && logConfirmado < vivoEnviado) {
+      bfEnviado        = logConfirmado;
+      bfUltimoAvanceMs = millis();
+      backfillActivo   = true;
+      Consola.print("[LOG] Hueco en la confirmación: reenviando desde seq ");
+      Consola.println(logConfirmado + 1);
+    }
+  }
+}
+
+// Guarda el reporte horario (un registro por nodo). Devuelve el último seq.
+uint32_t registrarReporteEnFlash() {
+  uint32_t ultimo  = 0;
+  uint32_t uptimeS = millis() / 1000;
+  File     f;  // segmento abierto durante todo el reporte
+  nReporteActual = 0;
+  for (uint16_t i = 0; i < MAX_NODOS; i++) {
+    const NodoEstado& n = nodos[i];
+    if (n.id == 0) continue;
+
+    RegistroRadon& r = reporteActual[nReporteActual++];
+    memset(&r, 0, sizeof(r));
+    r.unixTime  = (unixArranqueS != 0) ? unixArranqueS + uptimeS : 0;
+    r.uptimeS   = uptimeS;
+    r.boot      = bootCount;
+    r.nodo      = n.id;
+    r.cuentas   = n.pulsosHora;
+    r.vetadas   = n.vetadosHora;
+    r.actividad = actividadBqm3(n.pulsosHora);
+    r.ventanaS  = (uint16_t)T_WINDOW_SEC;
+
+    PROF_INICIO(profFlash);
+    uint32_t seq = registrarEnFlash(r, f);
+    PROF_FIN(histFlash, profFlash);
+    if (seq != 0) {
+      ultimo = seq;
+    } else {
+      r.crc = crc16((const uint8_t*)&r, sizeof(r) - 2);  // sin flash: seq = 0
+    }
+    // Borrar sectores al pasar de segmento cuesta decenas de ms
+    esp_task_wdt_reset();
+  }
+  if (f) f.close();
+  return ultimo;
+}
+
+void enviarEstadisticas() {
+  Estadisticas e;
+  e.uptimeS        = millis() / 1000;
+  e.msgCount       = msgCount;
+  e.coincAceptados = coincAceptados;
+  e.coincVetados   = coincVetados;
+  e.coincDesbordes = coincDesbordes;
+  e.ultimoSeq      = logUltimoSeq();
+  e.confirmado     = logConfirmado;
+  e.heapLibre      = ESP.getFreeHeap();
+  e.nodosActivos   = 0;
+  e.boot           = bootCount;
+  e.coincCasuales  = (uint32_t)(coincCasuales + 0.5f);
+  e.coincTardios   = coincTardios;
+  e.tramasRechazadas = tramasRechazadas;
+  e.tramasGrandes    = tramasGrandes;
+  for (uint16_t i = 0; i < MAX_NODOS; i++) {
+    if (nodos[i].id != 0 && millis() - nodos[i].ultimoMensajeMs < NODO_TIMEOUT_MS) {
+      e.nodosActivos++;
+    }
+  }
+  enviarTrama(TRAMA_ESTADISTICAS, (const uint8_t*)&e, sizeof(e));
+}
+
 // =======================================================
 //   ENVIAR ACTIVIDAD AL RASPBERRY PI POR SERIAL (JSON)
 // =======================================================
-void sendActivityToRpiSerial(float Cn1_Bq_m3,
-                             float Cn2_Bq_m3) {
-  String payload = "{";
-  payload += "\"radon_activity_nodo1\":" + String(Cn1_Bq_m3, 3) + ",";
-  payload += "\"radon_activity_nodo2\":" + String(Cn2_Bq_m3, 3);
-  payload += "}";
+// {"radon_activity_nodo1":x,"vetoed_nodo1":n,"accidental_nodo1":e,...,"first_seq":f,"seq":s}
+// para cada nodo conocido, con "accidental" las vetadas que se esperaban por
+// azar; "first_seq" y "seq" son el primer y el último registro en flash del
+// reporte (para el ACK sin huecos).
+// En modo binario el reporte sale con los mismos registros que se guardan en
+// flash, de BACKFILL_LOTE en BACKFILL_LOTE: las partes que siguen van como
+// TRAMA_REPORTE_SIGUE y la última como TRAMA_REPORTE, que cierra el reporte.
+// Sale poco a poco con enviarReportePendiente.
+void sendActivityToRpiSerial(uint32_t seq) {
+  seqReporte = seq;
+  if (upstreamBinario) {
+    reporteEnviado = 0;
+    enviarReportePendiente();
+    return;
+  }
 
-  Serial.print("RADON_JSON ");
-  Serial.println(payload);
+  // La línea se arma directamente en el buffer de envío: con cientos de
+  // nodos son decenas de kB y una copia más duplicaría el pico de heap
+  String& payload = jsonPendiente;
+  payload = "RADON_JSON {";
+  bool primero = true;
+  for (uint16_t i = 0; i < MAX_NODOS; i++) {
+    const NodoEstado& n = nodos[i];
+    if (n.id == 0) continue;
+    if (!primero) payload += ",";
+    primero = false;
+    payload += "\"radon_activity_nodo" + String(n.id) + "\":" + String(actividadBqm3(n.pulsosHora), 3) + ",";
+    payload += "\"vetoed_nodo" + String(n.id) + "\":" + String(n.vetadosHora) + ",";
+    payload += "\"accidental_nodo" + String(n.id) + "\":" + String(n.casualesHora, 1);
+  }
+  if (!primero) payload += ",";
+  uint32_t primerSeq = 0;
+  for (uint16_t i = 0; i < nReporteActual && primerSeq == 0; i++) primerSeq = reporteActual[i].seq;
+  payload += "\"first_seq\":" + String(primerSeq) + ",";
+  payload += "\"seq\":" + String(seq);
+  payload += "}\r\n";
+
+  jsonEnviado    = 0;
+  lineaEnCurso   = true;
+  reporteEnviado = nReporteActual;
+  enviarReportePendiente();
 
-  Serial.println("Enviado al Raspberry Pi:");
-  Serial.println(payload);
+  // En modo texto la línea ya es la salida de la consola: no se repite
+  Consola.print("Enviado al Raspberry Pi, seq ");
+  Consola.println(seq);
 }
 
 // =======================================================
-//   PROCESAR MENSAJES DE NODOS: "Nodo_1;C=123"
+//   PROCESAR MENSAJES DE NODOS: "Nodo_1;C=123;S=<ms>;T=<edad>,..."
 // =======================================================
 void processNodeMessage(const String& msg) {
-  Serial.print("\n[processNodeMessage] msg = \"");
-  Serial.print(msg);
-  Serial.println("\"");
+  Consola.print("\n[processNodeMessage] msg = \"");
+  Consola.print(msg);
+  Consola.println("\"");
 
   int sep = msg.indexOf(';');
-  Serial.print("sep = ");
-  Serial.println(sep);
+  Consola.print("sep = ");
+  Consola.println(sep);
 
   if (sep < 0) {
-    Serial.println(" -> Formato inválido (sin ';'), se ignora.");
+    Consola.println(" -> Formato inválido (sin ';'), se ignora.");
     return;
   }
 
@@ -79,11 +1158,11 @@ void processNodeMessage(const String& msg) {
   nodeId.trim();
 
   int idxC = msg.indexOf("C=", sep + 1);
-  Serial.print("idxC = ");
-  Serial.println(idxC);
+  Consola.print("idxC = ");
+  Consola.println(idxC);
 
   if (idxC < 0) {
-    Serial.println(" -> No se encontró 'C=', se ignora.");
+    Consola.println(" -> No se encontró 'C=', se ignora.");
     return;
   }
 
@@ -91,23 +1170,61 @@ void processNodeMessage(const String& msg) {
   cStr.trim();
   unsigned long delta = (unsigned long)cStr.toInt();
 
-  Serial.print(" -> Pulsos recibidos desde ");
-  Serial.print(nodeId);
-  Serial.print(" = ");
-  Serial.println(delta);
+  Consola.print(" -> Pulsos recibidos desde ");
+  Consola.print(nodeId);
+  Consola.print(" = ");
+  Consola.println(delta);
+
+  uint16_t id = parseNodeId(nodeId);
+  NodoEstado* nodo = (id != 0) ? buscarNodo(id, true) : NULL;
+  if (nodo == NULL) {
+    Consola.println(" -> Nodo desconocido o tabla llena, se ignora para acumuladores.");
+    return;
+  }
+
+  unsigned long ahoraMs = millis();
+  nodo->ultimoMensajeMs = ahoraMs;
 
-  if (nodeId.indexOf('1') >= 0) {
-    pulsesNode1Hour += delta;
-  } else if (nodeId.indexOf('2') >= 0) {
-    pulsesNode2Hour += delta;
+  int idxS = msg.indexOf(";S=", idxC);
+  if (idxS < 0) {
+    // Formato sin marcas de tiempo: se cuenta sin veto
+    nodo->pulsosHora += delta;
   } else {
-    Serial.println(" -> Nodo desconocido, se ignora para acumuladores.");
+    // Instante (reloj base) en que el nodo tomó S: restar lo que tardó la
+    // línea (con "\r\n") en los dos tramos y en el aire
+    unsigned long rxMs  = ahoraMs - ((msg.length() + 2) * (NODO_US_POR_BYTE + XBEE_US_POR_BYTE)
+                                     + XBEE_AIRE_US) / 1000;
+    unsigned long sNodo = strtoul(msg.c_str() + idxS + 3, NULL, 10);
+    actualizarReloj(*nodo, sNodo, rxMs);
+
+    unsigned long nTs = 0;
+    int idxT = msg.indexOf(";T=", idxS);
+    if (idxT >= 0) {
+      const char* p = msg.c_str() + idxT + 3;
+      for (;;) {
+        char* fin;
+        unsigned long edad = strtoul(p, &fin, 10);
+        if (fin == p) break;
+        encolarEvento(*nodo, rxMs - (unsigned long)(edad * nodo->tasaReloj));
+        nTs++;
+        if (*fin != ',') break;
+        p = fin + 1;
+      }
+    }
+    // Pulsos que no cupieron en las marcas del nodo: no se pueden comparar
+    if (delta > nTs) nodo->pulsosHora += delta - nTs;
+    nodo->marcaAguaMs = rxMs;
+
+    Consola.print("   Marcas de tiempo recibidas = ");
+    Consola.println(nTs);
   }
 
-  Serial.print("   Acumulado Nodo_1 (cuentas/hora) = ");
-  Serial.println(pulsesNode1Hour);
-  Serial.print("   Acumulado Nodo_2 (cuentas/hora) = ");
-  Serial.println(pulsesNode2Hour);
+  Consola.print("   Acumulado ");
+  Consola.print(nodeId);
+  Consola.print(" (cuentas/hora) = ");
+  Consola.print(nodo->pulsosHora);
+  Consola.print(", pendientes de coincidencia = ");
+  Consola.println(nodo->colaN);
 }
 
 // =======================================================
@@ -124,15 +1241,182 @@ bool processHandshakeMessage(const String& msg) {
   String nodeId = msg.substring(0, sep);
   nodeId.trim();
 
-  Serial.println();
-  Serial.println("========================================");
-  Serial.print(" [HANDSHAKE] Mensaje de conexión desde ");
-  Serial.println(nodeId);
-  Serial.println("========================================");
+  Consola.println();
+  Consola.println("========================================");
+  Consola.print(" [HANDSHAKE] Mensaje de conexión desde ");
+  Consola.println(nodeId);
+  Consola.println("========================================");
+
+  Consola.print("[HANDSHAKE] Conectado: ");
+  Consola.println(nodeId);
+
+  // "R=<causa>;E=<estado restaurado>;B=<us hasta la primera muestra>"
+  int idxR = msg.indexOf(";R=");
+  if (idxR >= 0) {
+    Consola.print("[HANDSHAKE] Arranque del nodo: ");
+    Consola.println(msg.substring(idxR + 1));
+  }
+
+  // Un HELLO indica reinicio del nodo: su reloj vuelve a cero
+  uint16_t id = parseNodeId(nodeId);
+  NodoEstado* nodo = (id != 0) ? buscarNodo(id, true) : NULL;
+  if (nodo != NULL) {
+    nodo->relojInit       = false;
+    nodo->ultimoMensajeMs = millis();
+  }
+
+  return true;
+}
+
+// =======================================================
+//   CAPTURAS DE FORMA DE ONDA "Nodo_X;W=<id>;..."
+// =======================================================
+// La base no interpreta las muestras: reenvía cada trozo al Raspberry Pi,
+// que arma la captura y la guarda.
+bool processWaveformMessage(const String& msg) {
+  if (msg.indexOf(";W=") < 0) {
+    return false;  // no es captura
+  }
+
+  if (upstreamBinario) {
+    enviarTrama(TRAMA_CAPTURA, (const uint8_t*)msg.c_str(), msg.length());
+  } else {
+    enviarLineaTexto("RADON_WAVE ", msg);
+  }
+  return true;
+}
+
+// =======================================================
+//   LATENCIAS DE LOS NODOS "Nodo_X;P=<nombre>;..."
+// =======================================================
+bool processProfileMessage(const String& msg) {
+  if (msg.indexOf(";P=") < 0) {
+    return false;  // no es perfil
+  }
+
+  if (upstreamBinario) {
+    enviarTrama(TRAMA_PERFIL_NODO, (const uint8_t*)msg.c_str(), msg.length());
+  } else {
+    enviarLineaTexto("RADON_PROF ", msg);
+  }
+  return true;
+}
+
+// =======================================================
+//   WATCHDOG Y ESTADO RETENIDO
+// =======================================================
+// El watchdog de tareas reinicia la base si el loop no vuelve en
+// WDT_TIMEOUT_S. Cada ESTADO_CADA_MS (y tras cada reporte horario) los
+// acumuladores de la hora, los contadores, la hora unix, el modo del enlace
+// y la fase del reporte se copian a RAM que el arranque no borra
+// (__NOINIT_ATTR): tras un reinicio por watchdog, pánico o software la hora
+// en curso sigue donde estaba. Lo ya publicado está en la flash; un corte
+// de alimentación solo pierde la hora en curso.
+const uint32_t      WDT_TIMEOUT_S  = 2;
+const unsigned long ESTADO_CADA_MS = 1000;
+const uint32_t      ESTADO_MAGIC   = 0x52445354;  // "RDST"
+
+struct EstadoNodoRetenido {
+  uint16_t id;
+  uint32_t pulsosHora;
+  uint32_t vetadosHora;
+  float    casualesHora;
+  uint32_t pendientes;  // eventos que esperaban el veto: se aceptan sin comparar
+};
+
+struct EstadoRetenido {
+  uint32_t           magic;
+  uint32_t           publicadoHaceMs;  // desde el último reporte horario
+  uint32_t           unixS;            // hora unix al guardar (0 = sin SYNC)
+  uint32_t           msgCount;
+  uint32_t           coincAceptados;
+  uint32_t           coincVetados;
+  uint32_t           coincDesbordes;
+  uint32_t           coincTardios;
+  float              coincCasuales;
+  uint8_t            binario;
+  uint8_t            eco;              // canales que el host dejó encendidos
+  uint8_t            depuracion;
+  EstadoNodoRetenido nodos[MAX_NODOS];
+  uint16_t           crc;
+};
+
+__NOINIT_ATTR EstadoRetenido estadoRam;
+unsigned long ultimoEstadoMs = 0;
+
+const char* nombreCausaReset(esp_reset_reason_t c) {
+  switch (c) {
+    case ESP_RST_POWERON:   return "encendido";
+    case ESP_RST_EXT:       return "pin de reset";
+    case ESP_RST_SW:        return "software";
+    case ESP_RST_PANIC:     return "pánico";
+    case ESP_RST_INT_WDT:   return "watchdog de interrupciones";
+    case ESP_RST_TASK_WDT:  return "watchdog de tareas";
+    case ESP_RST_WDT:       return "watchdog";
+    case ESP_RST_DEEPSLEEP: return "deep sleep";
+    case ESP_RST_BROWNOUT:  return "brown-out";
+    default:                return "desconocida";
+  }
+}
+
+void guardarEstado(unsigned long now) {
+  EstadoRetenido& e = estadoRam;
+  e.magic           = ESTADO_MAGIC;
+  e.publicadoHaceMs = now - lastPublish;
+  e.unixS           = (unixArranqueS != 0) ? unixArranqueS + now / 1000 : 0;
+  e.msgCount        = msgCount;
+  e.coincAceptados  = coincAceptados;
+  e.coincVetados    = coincVetados;
+  e.coincDesbordes  = coincDesbordes;
+  e.coincTardios    = coincTardios;
+  e.coincCasuales   = coincCasuales;
+  e.binario         = upstreamBinario;
+  e.eco             = EcoXbee.activo;
+  e.depuracion      = Consola.activo;
+  for (uint16_t i = 0; i < MAX_NODOS; i++) {
+    e.nodos[i].id           = nodos[i].id;
+    e.nodos[i].pulsosHora   = nodos[i].pulsosHora;
+    e.nodos[i].vetadosHora  = nodos[i].vetadosHora;
+    e.nodos[i].casualesHora = nodos[i].casualesHora;
+    e.nodos[i].pendientes   = nodos[i].colaN;
+  }
+  e.crc = crc16((const uint8_t*)&e, offsetof(EstadoRetenido, crc));
+  ultimoEstadoMs = now;
+}
 
-  Serial.print("[HANDSHAKE] Conectado: ");
-  Serial.println(nodeId);
+// Solo tras un reinicio con la RAM alimentada y un bloque íntegro. La
+// conversión de reloj de cada nodo se rehace con su próximo reporte.
+bool restaurarEstado(esp_reset_reason_t causa) {
+  const EstadoRetenido& e = estadoRam;
+  if (causa == ESP_RST_POWERON || causa == ESP_RST_BROWNOUT) return false;
+  if (e.magic != ESTADO_MAGIC || e.crc != crc16((const uint8_t*)&e, offsetof(EstadoRetenido, crc))) {
+    return false;
+  }
 
+  unsigned long now = millis();
+  lastPublish     = now - e.publicadoHaceMs;
+  unixArranqueS   = (e.unixS != 0) ? e.unixS - now / 1000 : 0;
+  msgCount        = e.msgCount;
+  coincAceptados  = e.coincAceptados;
+  coincVetados    = e.coincVetados;
+  coincDesbordes  = e.coincDesbordes;
+  coincTardios    = e.coincTardios;
+  coincCasuales   = e.coincCasuales;
+  upstreamBinario = e.binario;
+  EcoXbee.activo  = e.eco;
+  Consola.activo  = e.depuracion;
+  for (uint16_t i = 0; i < MAX_NODOS; i++) {
+    const EstadoNodoRetenido& r = e.nodos[i];
+    if (r.id == 0) continue;
+    NodoEstado* n = buscarNodo(r.id, true);
+    if (n == NULL) break;
+    n->ultimoMensajeMs = now;
+    n->pulsosHora      = r.pulsosHora + r.pendientes;
+    n->vetadosHora     = r.vetadosHora;
+    n->casualesHora    = r.casualesHora;
+    coincAceptados += r.pendientes;
+    coincDesbordes += r.pendientes;
+  }
   return true;
 }
 
@@ -140,53 +1424,86 @@ bool processHandshakeMessage(const String& msg) {
 //   SETUP
 // =======================================================
 void setup() {
+  // Primero la UART del XBee: su buffer guarda lo que llegue mientras se
+  // monta la flash. Sin esperas fijas; lo que se imprima antes de que el
+  // Raspberry abra el puerto se pierde, pero el estado se pide con SYNC.
+  Serial2.setRxBufferSize(1024);  // margen mientras se escribe en flash
+  Serial2.begin(XBEE_BAUD, SERIAL_8N1, XBEE_RX_PIN, XBEE_TX_PIN);
+  Serial.setTxBufferSize(4096);   // tramas de reenvío y ráfagas de depuración
   Serial.begin(115200);
-  delay(2000);
 
-  Serial.println();
-  Serial.println("Base ESP32 (actividad radón, 2 nodos) -> Raspberry Pi por USB");
+  esp_reset_reason_t causa = esp_reset_reason();
+  bool restaurado = restaurarEstado(causa);
+  if (!restaurado) lastPublish = millis();
 
-  Serial2.begin(XBEE_BAUD, SERIAL_8N1, XBEE_RX_PIN, XBEE_TX_PIN);
-  Serial.print("UART2 configurado en RX=");
-  Serial.print(XBEE_RX_PIN);
-  Serial.print(" TX=");
-  Serial.println(XBEE_TX_PIN);
+  Consola.println();
+  Consola.print("Base ESP32 (actividad radón, hasta ");
+  Consola.print(MAX_NODOS);
+  Consola.println(" nodos) -> Raspberry Pi por USB");
+  Consola.print("UART2 configurado en RX=");
+  Consola.print(XBEE_RX_PIN);
+  Consola.print(" TX=");
+  Consola.println(XBEE_TX_PIN);
+
+  iniciarLogFlash();
 
-  lastPublish = millis();
+  // Después de montar la flash: formatearla la primera vez tarda segundos
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+  // Núcleo 3.x (IDF 5): el núcleo ya inició el watchdog, se reconfigura
+  esp_task_wdt_config_t wdt = {WDT_TIMEOUT_S * 1000, 0, true};  // ms, sin tareas idle, pánico
+  esp_task_wdt_reconfigure(&wdt);
+#else
+  esp_task_wdt_init(WDT_TIMEOUT_S, true);  // núcleo 2.x (IDF 4); true: pánico y reinicio
+#endif
+  esp_task_wdt_add(NULL);                  // la tarea del loop
+
+  Consola.print("[ARRANQUE] Causa: ");
+  Consola.print(nombreCausaReset(causa));
+  Consola.print(restaurado ? ", hora en curso restaurada" : ", sin estado previo");
+  Consola.print(", leyendo el XBee a los ");
+  Consola.print(millis());
+  Consola.println(" ms");
 }
 
 // =======================================================
 //   LOOP
 // =======================================================
 void loop() {
+  PROF_INICIO(profLoop);
+  esp_task_wdt_reset();
+
   // Heartbeat cada 15 minutos
   static unsigned long lastHeartbeat = 0;
   if (millis() - lastHeartbeat >= HEARTBEAT_INTERVAL_MS) {
     lastHeartbeat = millis();
-    Serial.println("[loop] ESP32 vivo, esperando datos del XBee...");
+    Consola.println("[loop] ESP32 vivo, esperando datos del XBee...");
   }
 
   // 1) Leer mensajes desde el XBee
   while (Serial2.available()) {
     char c = Serial2.read();
 
-    Serial.write(c);  // eco hacia el Raspi
+    EcoXbee.write(c);  // eco hacia el Raspi
 
     if (c == '\n' || c == '\r') {
       xbeeLine.trim();
       if (xbeeLine.length() > 0) {
         msgCount++;
-        Serial.println();
-        Serial.println("========================================");
-        Serial.print(" MENSAJE #");
-        Serial.println(msgCount);
-        Serial.println("========================================");
-
-        // Primero: ¿es handshake (HELLO)?
-        if (!processHandshakeMessage(xbeeLine)) {
-          // Si no es HELLO, lo procesamos como medición
+        Consola.println();
+        Consola.println("========================================");
+        Consola.print(" MENSAJE #");
+        Consola.println(msgCount);
+        Consola.println("========================================");
+
+        // Primero: ¿es handshake (HELLO)? Luego: ¿captura o perfil?
+        PROF_INICIO(profParse);
+        if (!processHandshakeMessage(xbeeLine) &&
+            !processWaveformMessage(xbeeLine) &&
+            !processProfileMessage(xbeeLine)) {
+          // Si no, lo procesamos como medición
           processNodeMessage(xbeeLine);
         }
+        PROF_FIN(histParse, profParse);
       }
       xbeeLine = "";
     } else {
@@ -196,35 +1513,102 @@ void loop() {
     }
   }
 
-  // 2) Cada hora: calcular actividad y enviarla al Raspi
+  // 2) Comandos del Raspberry (SYNC / ACK)
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c == '\n' || c == '\r') {
+      hostLine.trim();
+      if (hostLine.length() > 0) {
+        processHostCommand(hostLine);
+      }
+      hostLine = "";
+    } else if (c >= 32 && c <= 126 && hostLine.length() < 64) {
+      hostLine += c;
+    }
+  }
+
+  // 3) Veto por coincidencia de los eventos que ya se pueden decidir
   unsigned long now = millis();
+  procesarCoincidencias(now);
+
+  // 4) Resto del reporte horario, reenvío del historial en flash y
+  //    persistencia del último ACK
+  enviarReportePendiente();
+  procesarBackfill(now);
+  if (logOk && logIdxPendiente && now - logIdxGuardadoMs >= LOG_IDX_MIN_MS) {
+    guardarIndiceLog();
+  }
+
+  // 5) Cada hora: calcular actividad, guardarla en flash y enviarla al Raspi
   if (now - lastPublish >= PUBLISH_FREQUENCY) {
     lastPublish = now;
 
-    Serial.println();
-    Serial.println("==== Ventana de 1 hora completada ====");
-    Serial.print("Cuentas totales Nodo_1: ");
-    Serial.println(pulsesNode1Hour);
-    Serial.print("Cuentas totales Nodo_2: ");
-    Serial.println(pulsesNode2Hour);
-
-    float N1 = (float)pulsesNode1Hour;
-    float N2 = (float)pulsesNode2Hour;
+    Consola.println();
+    Consola.println("==== Ventana de 1 hora completada ====");
+    Consola.println("---- Actividad estimada (Radon Activity) ----");
+    for (uint16_t i = 0; i < MAX_NODOS; i++) {
+      const NodoEstado& n = nodos[i];
+      if (n.id == 0) continue;
+      Consola.print("Nodo_");
+      Consola.print(n.id);
+      Consola.print(": cuentas = ");
+      Consola.print(n.pulsosHora);
+      Consola.print(", vetadas = ");
+      Consola.print(n.vetadosHora);
+      Consola.print(" (por azar ~");
+      Consola.print(n.casualesHora, 1);
+      Consola.print("), actividad = ");
+      Consola.print(actividadBqm3(n.pulsosHora), 3);
+      Consola.println(" Bq/m^3");
+    }
+    Consola.print("Filtro de coincidencia (total): aceptados = ");
+    Consola.print(coincAceptados);
+    Consola.print(", vetados = ");
+    Consola.print(coincVetados);
+    Consola.print(" (por azar ~");
+    Consola.print(coincCasuales, 1);
+    Consola.print("), desbordes = ");
+    Consola.print(coincDesbordes);
+    Consola.print(", tardíos = ");
+    Consola.println(coincTardios);
+    Consola.print("Depuración descartada por Serial lleno: ");
+    Consola.print(bytesDescartados);
+    Consola.print(" B; tramas rechazadas: ");
+    Consola.print(tramasRechazadas);
+    Consola.print(", demasiado largas: ");
+    Consola.println(tramasGrandes);
 
-    float Cn1_Bq_m3 = N1 * 1000.0f / (T_WINDOW_SEC * S_act_cps_per_BqL);
-    float Cn2_Bq_m3 = N2 * 1000.0f / (T_WINDOW_SEC * S_act_cps_per_BqL);
+    uint32_t seq = registrarReporteEnFlash();
+    sendActivityToRpiSerial(seq);
 
-    Serial.println("---- Actividad estimada (Radon Activity) ----");
-    Serial.print("Nodo_1: ");
-    Serial.print(Cn1_Bq_m3, 3);
-    Serial.println(" Bq/m^3");
-    Serial.print("Nodo_2: ");
-    Serial.print(Cn2_Bq_m3, 3);
-    Serial.println(" Bq/m^3");
+    for (uint16_t i = 0; i < MAX_NODOS; i++) {
+      nodos[i].pulsosHora   = 0;
+      nodos[i].vetadosHora  = 0;
+      nodos[i].casualesHora = 0;
+    }
+    guardarEstado(now);
+  }
 
-    sendActivityToRpiSerial(Cn1_Bq_m3, Cn2_Bq_m3);
+  // Estado de la hora en curso para un reinicio por watchdog
+  if (now - ultimoEstadoMs >= ESTADO_CADA_MS) {
+    guardarEstado(now);
+  }
 
-    pulsesNode1Hour = 0;
-    pulsesNode2Hour = 0;
+  // 6) Modo binario: estadísticas periódicas y eventos; vaciado de los canales
+  if (upstreamBinario) {
+    if (now - ultimasEstadMs >= ESTADISTICAS_MS) {
+      ultimasEstadMs = now;
+      enviarEstadisticas();
+#if RADON_PROFILE
+      enviarPerfilBase();
+#endif
+    }
+    if (nEventosLote > 0 && now - eventosPrimeroMs >= EVENTOS_MAX_MS) {
+      vaciarEventos();
+    }
   }
+  EcoXbee.vaciarSiVence(now);
+  Consola.vaciarSiVence(now);
+
+  PROF_FIN(histLoop, profLoop);
 }
@@ -0,0 +1,304 @@
+/*
+ * Sustituto mínimo del núcleo de Arduino para compilar los sketches tal cual
+ * en el PC (banco de pruebas del detector, simulación de la base).
+ *
+ * El tiempo es simulado: millis()/micros() leen sim::nowUs, que solo avanza
+ * cuando el sketch hace algo que en el hardware real cuesta tiempo: leer el
+ * ADC, esperar con delay() o escribir en un puerto serie más rápido de lo que
+ * este puede transmitir (o cuando el simulador lo adelanta). Como en el
+ * hardware, millis() y micros() son de 32 bits y dan la vuelta a los 49 días y
+ * a los 71 minutos; quien incluya un sketch debe compilarlo con long de 32
+ * bits (ver radon_bench.cpp) para que las restas den la vuelta igual.
+ */
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW  0
+#define INPUT  0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define DEC 10
+#define HEX 16
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define LED_BUILTIN 13
+
+#define SERIAL_8N1 0x800001c
+
+// Cadenas en flash del AVR: aquí son punteros normales
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+// Registros del AVR: MCUSR (causa del reinicio) no existe fuera del Nano
+#define _BV(b) (1 << (b))
+#define PORF  0
+#define EXTRF 1
+#define BORF  2
+#define WDRF  3
+
+// Timer1 del AVR (RADON_PROFILE en los nodos): cuenta con el reloj simulado
+// a 16 MHz dividido por el prescaler de TCCR1B (CS12..CS10); 0 = parado
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define TCCR1A sim::tccr1a
+#define TCCR1B sim::tccr1b
+#define TCNT1  sim::timer1()
+
+template <class T> inline T min(T a, T b) { return b < a ? b : a; }
+template <class T> inline T max(T a, T b) { return a < b ? b : a; }
+
+// =======================================================
+// RELOJ Y PERIFÉRICOS SIMULADOS
+// =======================================================
+namespace sim {
+
+extern uint64_t nowUs;
+
+// Costo de una conversión del ADC (Nano: 13 ciclos con prescaler 128 + llamada)
+extern uint32_t adcCostUs;
+
+// Señal de cada pin analógico: devuelve la cuenta del ADC en el instante dado
+extern std::function<int(uint8_t pin, uint64_t us)> adcSource;
+
+// Lecturas del ADC hechas desde el arranque
+extern uint64_t adcReads;
+
+inline void advance(uint64_t us) { nowUs += us; }
+
+// Heap del ESP32: libre al arrancar y lo que el sketch lleva asignado. Lo
+// lleva quien enlace su propio operator new (radon_loadgen) mientras
+// heapCounting esté activo; lo que reserva el simulador no cuenta.
+extern uint32_t heapTotal;
+extern size_t   heapUsed;
+extern bool     heapCounting;
+
+struct HeapPause {
+  bool prev;
+  HeapPause() : prev(heapCounting) { heapCounting = false; }
+  ~HeapPause() { heapCounting = prev; }
+};
+
+// Watchdog del Nano o del ESP32: si entre dos alimentaciones pasa más que
+// el plazo, el hardware se habría reiniciado; se cuenta en wdtTrips.
+extern uint64_t wdtTimeoutUs;  // 0 = desarmado
+extern uint64_t wdtKickUs;
+extern uint64_t wdtTrips;
+
+void wdtArm(uint64_t timeoutUs);
+void wdtKick();
+
+// EEPROM del Nano (1 KB, borrada a 0xFF); cada byte escrito cuesta ~3.4 ms
+const size_t kEepromSize = 1024;
+extern uint8_t  eeprom[kEepromSize];
+extern uint32_t eepromWriteUs;
+extern uint64_t eepromWrites;
+
+// Vuelve al estado de arranque (reloj, contadores y puertos serie)
+void reset();
+
+// Timer1 del AVR
+extern uint8_t tccr1a;
+extern uint8_t tccr1b;
+uint16_t timer1();
+
+}  // namespace sim
+
+unsigned long millis();
+unsigned long micros();
+void          delay(unsigned long ms);
+void          delayMicroseconds(unsigned int us);
+void          yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int  digitalRead(uint8_t pin);
+int  analogRead(uint8_t pin);
+
+// Pseudoaleatorio reproducible (en el ESP32 sale del generador del hardware)
+long random(long howbig);
+long random(long howmin, long howmax);
+
+// =======================================================
+// STRING
+// =======================================================
+class String {
+ public:
+  String(const char* c = "") : s_(c ? c : "") {}
+  String(const std::string& s) : s_(s) {}
+  explicit String(char c) : s_(1, c) {}
+  String(int v, unsigned char base = DEC) : s_(fromLong((long)v, base)) {}
+  String(unsigned int v, unsigned char base = DEC) : s_(fromULong(v, base)) {}
+  String(long v, unsigned char base = DEC) : s_(fromLong(v, base)) {}
+  String(unsigned long v, unsigned char base = DEC) : s_(fromULong(v, base)) {}
+  String(float v, unsigned char dec = 2) : s_(fromDouble(v, dec)) {}
+  String(double v, unsigned char dec = 2) : s_(fromDouble(v, dec)) {}
+
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  const char*  c_str() const { return s_.c_str(); }
+  bool         reserve(unsigned int n) { s_.reserve(n); return true; }
+  char         charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char         operator[](unsigned int i) const { return charAt(i); }
+
+  int indexOf(char c, unsigned int from = 0) const { return pos(s_.find(c, from)); }
+  int indexOf(const char* t, unsigned int from = 0) const { return pos(s_.find(t, from)); }
+  int indexOf(const String& t, unsigned int from = 0) const { return indexOf(t.c_str(), from); }
+  int lastIndexOf(char c) const { return pos(s_.rfind(c)); }
+  int lastIndexOf(const char* t) const { return pos(s_.rfind(t)); }
+
+  String substring(unsigned int a) const { return a > s_.size() ? String() : String(s_.substr(a)); }
+  String substring(unsigned int a, unsigned int b) const {
+    if (a > b) std::swap(a, b);
+    if (a > s_.size()) return String();
+    return String(s_.substr(a, b - a));
+  }
+
+  bool startsWith(const String& p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String& p) const {
+    return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+  bool equals(const String& o) const { return s_ == o.s_; }
+
+  void trim() {
+    size_t a = s_.find_first_not_of(" \t\r\n");
+    size_t b = s_.find_last_not_of(" \t\r\n");
+    s_ = (a == std::string::npos) ? std::string() : s_.substr(a, b - a + 1);
+  }
+
+  long  toInt() const { return std::strtol(s_.c_str(), NULL, 10); }
+  float toFloat() const { return (float)std::strtod(s_.c_str(), NULL); }
+
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* o) { s_ += o; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  bool    concat(const String& o) { s_ += o.s_; return true; }
+
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator==(const char* o) const { return s_ == o; }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator!=(const char* o) const { return s_ != o; }
+
+  friend String operator+(const String& a, const String& b) { return String(a.s_ + b.s_); }
+  friend String operator+(const String& a, const char* b) { return String(a.s_ + b); }
+  friend String operator+(const char* a, const String& b) { return String(a + b.s_); }
+  friend String operator+(const String& a, char b) { return String(a.s_ + b); }
+
+ private:
+  static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+  static std::string fromLong(long v, unsigned char base);
+  static std::string fromULong(unsigned long v, unsigned char base);
+  static std::string fromDouble(double v, unsigned char dec);
+
+  std::string s_;
+};
+
+// =======================================================
+// PRINT / STREAM / HARDWARESERIAL
+// =======================================================
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* b, size_t n) {
+    for (size_t i = 0; i < n; i++) write(b[i]);
+    return n;
+  }
+  size_t write(const char* s) { return write((const uint8_t*)s, std::strlen(s)); }
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(const __FlashStringHelper* s) { return write((const char*)s); }
+  size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC);
+  size_t print(unsigned long v, int base = DEC);
+  size_t print(double v, int dec = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <class T> size_t println(const T& v) { size_t n = print(v); return n + println(); }
+  template <class T> size_t println(const T& v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+};
+
+// UART con buffer de transmisión: escribir es gratis mientras quepa en el
+// buffer; si se llena, el sketch queda esperando a que salgan los bytes.
+// Lo recibido se entrega con inject() y lo transmitido a output.
+class HardwareSerial : public Stream {
+ public:
+  HardwareSerial(size_t txBuffer = 64, size_t rxBuffer = 64);
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+  void end() {}
+  void setTxBufferSize(size_t n) { txBuffer_ = n; }
+  void setRxBufferSize(size_t n) { rxBuffer_ = n; }
+  explicit operator bool() const { return true; }
+
+  int    available() override { return (int)rx_.size(); }
+  int    read() override;
+  int    peek() override { return rx_.empty() ? -1 : rx_.front(); }
+  int    availableForWrite();
+  size_t write(uint8_t c) override;
+  using Print::write;
+  void flush();
+
+  // Del lado del simulador
+  size_t inject(const uint8_t* b, size_t n);  // devuelve lo que cupo
+  void   reset();
+
+  std::function<void(uint8_t)> output;
+  uint64_t rxAccepted = 0;  // bytes que entraron al buffer de recepción
+  uint64_t rxRead     = 0;  // bytes leídos por el sketch
+  uint64_t rxOverflow = 0;  // bytes perdidos por buffer de recepción lleno
+
+ private:
+  uint32_t usPerByte() const { return (uint32_t)(10000000UL / baud_); }
+
+  unsigned long       baud_;
+  size_t              txBuffer_;
+  size_t              rxBuffer_;
+  uint64_t            txFreeUs_;  // instante en que termina de salir lo ya escrito
+  std::deque<uint8_t> rx_;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial2;
+
+// =======================================================
+// ESP32
+// =======================================================
+class EspClass {
+ public:
+  uint32_t getFreeHeap() const;
+  uint32_t getHeapSize() const { return sim::heapTotal; }
+  uint32_t getCycleCount() const;
+};
+
+extern EspClass ESP;
+
+uint32_t getCpuFrequencyMhz();
@@ -0,0 +1,35 @@
+/*
+ * EEPROM del Nano en el simulador: sim::eeprom, con el costo de escritura de
+ * cada byte que cambia (put() y update() no reescriben los iguales).
+ */
+#pragma once
+
+#include "Arduino.h"
+
+class EEPROMClass {
+ public:
+  uint8_t read(int idx) const { return sim::eeprom[idx]; }
+
+  void update(int idx, uint8_t v) {
+    if (sim::eeprom[idx] == v) return;
+    sim::eeprom[idx] = v;
+    sim::eepromWrites++;
+    sim::advance(sim::eepromWriteUs);
+  }
+  void write(int idx, uint8_t v) { update(idx, v); }
+
+  template <class T> T& get(int idx, T& t) const {
+    std::memcpy(&t, sim::eeprom + idx, sizeof(T));
+    return t;
+  }
+
+  template <class T> const T& put(int idx, const T& t) {
+    const uint8_t* b = (const uint8_t*)&t;
+    for (size_t i = 0; i < sizeof(T); i++) update(idx + (int)i, b[i]);
+    return t;
+  }
+
+  uint16_t length() const { return (uint16_t)sim::kEepromSize; }
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,81 @@
+/*
+ * LittleFS del ESP32 en el simulador: sistema de archivos en memoria con el
+ * tamaño de la partición de datos y un costo de tiempo aproximado por
+ * operación (la flash SPI borra sectores de 4 KB en decenas de ms).
+ */
+#pragma once
+
+#include "Arduino.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+extern uint32_t flashOpenUs;   // abrir o crear un archivo
+extern uint32_t flashCloseUs;  // cerrar tras escribir (programar página y metadatos)
+extern uint32_t flashEraseUs;  // cada bloque de 4 KB nuevo
+extern size_t   flashCapacity; // tamaño de la partición
+
+size_t flashUsed();  // bytes ocupados, redondeados a bloques
+
+}  // namespace sim
+
+class File {
+ public:
+  File() {}
+
+  explicit operator bool() const { return (bool)st_; }
+
+  size_t      write(const uint8_t* b, size_t n);
+  size_t      write(uint8_t c) { return write(&c, 1); }
+  size_t      read(uint8_t* b, size_t n);
+  int         read();
+  int         available();
+  bool        seek(uint32_t pos);
+  size_t      position() const { return st_ ? st_->pos : 0; }
+  size_t      size() const;
+  const char* name() const;
+  bool        isDirectory() const { return st_ && st_->dir; }
+  File        openNextFile();
+  void        close();
+
+ private:
+  friend class LittleFSClass;
+
+  struct State {
+    std::string              path;
+    bool                     dir      = false;
+    bool                     writable = false;
+    bool                     written  = false;
+    size_t                   pos      = 0;
+    std::vector<std::string> entries;  // solo directorios
+    size_t                   next     = 0;
+  };
+  std::shared_ptr<State> st_;
+};
+
+class LittleFSClass {
+ public:
+  bool   begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpen = 10,
+               const char* label = "spiffs");
+  void   end() {}
+  bool   format();
+  File   open(const char* path, const char* mode = "r", bool create = false);
+  File   open(const String& path, const char* mode = "r", bool create = false) {
+    return open(path.c_str(), mode, create);
+  }
+  bool   exists(const char* path);
+  bool   exists(const String& path) { return exists(path.c_str()); }
+  bool   mkdir(const char* path);
+  bool   mkdir(const String& path) { return mkdir(path.c_str()); }
+  bool   remove(const char* path);
+  bool   remove(const String& path) { return remove(path.c_str()); }
+  size_t totalBytes() const { return sim::flashCapacity; }
+  size_t usedBytes() const { return sim::flashUsed(); }
+};
+
+extern LittleFSClass LittleFS;
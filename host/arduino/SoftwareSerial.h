@@ -0,0 +1,28 @@
+/*
+ * SoftwareSerial del AVR en el simulador: transmite por software con las
+ * interrupciones desactivadas, así que cada byte escrito detiene el sketch
+ * 10 bits a la velocidad configurada. Lo transmitido va a output.
+ */
+#pragma once
+
+#include "Arduino.h"
+
+class SoftwareSerial : public Stream {
+ public:
+  SoftwareSerial(uint8_t rxPin, uint8_t txPin) : baud_(9600) { (void)rxPin; (void)txPin; }
+
+  void begin(long baud) { baud_ = baud; }
+  bool listen() { return true; }
+
+  size_t write(uint8_t c) override {
+    sim::advance(10000000UL / baud_);
+    if (output) output(c);
+    return 1;
+  }
+  using Print::write;
+
+  std::function<void(uint8_t)> output;
+
+ private:
+  long baud_;
+};
@@ -0,0 +1,230 @@
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "esp_system.h"
+
+#include <algorithm>
+
+HardwareSerial Serial;
+HardwareSerial Serial2;
+EspClass       ESP;
+EEPROMClass    EEPROM;
+
+namespace {
+
+struct EepromErased {
+  EepromErased() { std::memset(sim::eeprom, 0xFF, sizeof(sim::eeprom)); }
+} eepromErased;
+
+}  // namespace
+
+namespace sim {
+
+uint64_t nowUs     = 0;
+uint32_t adcCostUs = 112;
+uint64_t adcReads  = 0;
+uint32_t heapTotal = 300000;
+size_t   heapUsed  = 0;
+bool     heapCounting = false;
+
+uint64_t wdtTimeoutUs = 0;
+uint64_t wdtKickUs    = 0;
+uint64_t wdtTrips     = 0;
+
+uint8_t  eeprom[kEepromSize];
+uint32_t eepromWriteUs = 3400;
+uint64_t eepromWrites  = 0;
+
+uint8_t tccr1a = 0;
+uint8_t tccr1b = 0;
+
+std::function<int(uint8_t pin, uint64_t us)> adcSource;
+
+void wdtArm(uint64_t timeoutUs) {
+  wdtTimeoutUs = timeoutUs;
+  wdtKickUs    = nowUs;
+}
+
+void wdtKick() {
+  if (wdtTimeoutUs != 0 && nowUs - wdtKickUs > wdtTimeoutUs) wdtTrips++;
+  wdtKickUs = nowUs;
+}
+
+uint16_t timer1() {
+  static const uint16_t kPrescaler[8] = {0, 1, 8, 64, 256, 1024, 0, 0};  // 6, 7: reloj externo
+  uint16_t div = kPrescaler[tccr1b & 0x07];
+  return div ? (uint16_t)(nowUs * 16 / div) : 0;
+}
+
+// La EEPROM conserva su contenido: solo se borra al cargar el programa
+void reset() {
+  nowUs        = 0;
+  adcReads     = 0;
+  wdtTimeoutUs = 0;
+  wdtTrips     = 0;
+  tccr1a       = 0;
+  tccr1b       = 0;
+  Serial.reset();
+  Serial2.reset();
+}
+
+}  // namespace sim
+
+// =======================================================
+// TIEMPO, GPIO Y ADC
+// =======================================================
+
+// 32 bits, como en el hardware
+unsigned long millis() { return (uint32_t)(sim::nowUs / 1000); }
+unsigned long micros() { return (uint32_t)sim::nowUs; }
+
+void delay(unsigned long ms) { sim::advance((uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { sim::advance(us); }
+void yield() {}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int  digitalRead(uint8_t) { return LOW; }
+
+// El ADC muestrea al inicio de la conversión y el sketch espera a que termine
+int analogRead(uint8_t pin) {
+  int v = sim::adcSource ? sim::adcSource(pin, sim::nowUs) : 0;
+  sim::advance(sim::adcCostUs);
+  sim::adcReads++;
+  return v < 0 ? 0 : (v > 1023 ? 1023 : v);
+}
+
+namespace {
+uint32_t randomState = 0x2545F491;
+}
+
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return (long)(randomState % (uint32_t)howbig);
+}
+
+long random(long howmin, long howmax) {
+  return howmax > howmin ? howmin + random(howmax - howmin) : howmin;
+}
+
+// =======================================================
+// STRING / PRINT
+// =======================================================
+
+std::string String::fromULong(unsigned long v, unsigned char base) {
+  char t[40];
+  std::snprintf(t, sizeof(t), base == HEX ? "%lX" : "%lu", v);
+  return t;
+}
+
+std::string String::fromLong(long v, unsigned char base) {
+  if (base == HEX) return fromULong((unsigned long)v, base);
+  char t[40];
+  std::snprintf(t, sizeof(t), "%ld", v);
+  return t;
+}
+
+std::string String::fromDouble(double v, unsigned char dec) {
+  char t[64];
+  std::snprintf(t, sizeof(t), "%.*f", (int)dec, v);
+  return t;
+}
+
+size_t Print::print(long v, int base) {
+  char t[40];
+  if (base == HEX) {
+    std::snprintf(t, sizeof(t), "%lX", (unsigned long)v);
+  } else {
+    std::snprintf(t, sizeof(t), "%ld", v);
+  }
+  return write(t);
+}
+
+size_t Print::print(unsigned long v, int base) {
+  char t[40];
+  std::snprintf(t, sizeof(t), base == HEX ? "%lX" : "%lu", v);
+  return write(t);
+}
+
+size_t Print::print(double v, int dec) {
+  char t[64];
+  std::snprintf(t, sizeof(t), "%.*f", dec, v);
+  return write(t);
+}
+
+// =======================================================
+// HARDWARESERIAL
+// =======================================================
+
+HardwareSerial::HardwareSerial(size_t txBuffer, size_t rxBuffer)
+    : baud_(115200), txBuffer_(txBuffer), rxBuffer_(rxBuffer), txFreeUs_(0) {}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t, int8_t, int8_t) {
+  if (baud > 0) baud_ = baud;
+}
+
+int HardwareSerial::read() {
+  if (rx_.empty()) return -1;
+  uint8_t c = rx_.front();
+  rx_.pop_front();
+  rxRead++;
+  return c;
+}
+
+int HardwareSerial::availableForWrite() {
+  if (txFreeUs_ <= sim::nowUs) return (int)txBuffer_;
+  uint64_t pending = (txFreeUs_ - sim::nowUs + usPerByte() - 1) / usPerByte();
+  return pending >= txBuffer_ ? 0 : (int)(txBuffer_ - pending);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  const uint64_t us = usPerByte();
+  if (txFreeUs_ < sim::nowUs) txFreeUs_ = sim::nowUs;
+  // Buffer lleno: esperar a que salga lo necesario para que quepa este byte
+  if (txFreeUs_ + us > sim::nowUs + txBuffer_ * us) {
+    sim::nowUs = txFreeUs_ + us - txBuffer_ * us;
+  }
+  txFreeUs_ += us;
+  if (output) {
+    sim::HeapPause pause;
+    output(c);
+  }
+  return 1;
+}
+
+void HardwareSerial::flush() { sim::nowUs = std::max(sim::nowUs, txFreeUs_); }
+
+size_t HardwareSerial::inject(const uint8_t* b, size_t n) {
+  size_t room = rx_.size() < rxBuffer_ ? rxBuffer_ - rx_.size() : 0;
+  size_t k    = std::min(n, room);
+  rx_.insert(rx_.end(), b, b + k);
+  rxAccepted += k;
+  rxOverflow += n - k;
+  return k;
+}
+
+void HardwareSerial::reset() {
+  rx_.clear();
+  txFreeUs_  = 0;
+  rxAccepted = 0;
+  rxRead     = 0;
+  rxOverflow = 0;
+}
+
+// =======================================================
+// ESP32
+// =======================================================
+
+esp_reset_reason_t sim::resetReason = ESP_RST_POWERON;
+
+esp_reset_reason_t esp_reset_reason() { return sim::resetReason; }
+
+uint32_t getCpuFrequencyMhz() { return 240; }
+
+uint32_t EspClass::getFreeHeap() const {
+  return sim::heapUsed < sim::heapTotal ? sim::heapTotal - (uint32_t)sim::heapUsed : 0;
+}
+
+uint32_t EspClass::getCycleCount() const { return (uint32_t)(sim::nowUs * getCpuFrequencyMhz()); }
@@ -0,0 +1,6 @@
+/*
+ * Atributos de sección del ESP-IDF. En el PC __NOINIT_ATTR es RAM normal.
+ */
+#pragma once
+
+#define __NOINIT_ATTR
@@ -0,0 +1,26 @@
+/*
+ * Causa del último reinicio del ESP32 (ESP-IDF 4.x), fijada por el simulador.
+ */
+#pragma once
+
+typedef enum {
+  ESP_RST_UNKNOWN,
+  ESP_RST_POWERON,
+  ESP_RST_EXT,
+  ESP_RST_SW,
+  ESP_RST_PANIC,
+  ESP_RST_INT_WDT,
+  ESP_RST_TASK_WDT,
+  ESP_RST_WDT,
+  ESP_RST_DEEPSLEEP,
+  ESP_RST_BROWNOUT,
+  ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+namespace sim {
+
+extern esp_reset_reason_t resetReason;  // ESP_RST_POWERON por defecto
+
+}  // namespace sim
+
+esp_reset_reason_t esp_reset_reason();
@@ -0,0 +1,31 @@
+/*
+ * Watchdog de tareas del ESP-IDF sobre sim::wdt*: esp_task_wdt_init() del
+ * IDF 4.x (núcleo de Arduino 2.x) y esp_task_wdt_reconfigure() del IDF 5.x
+ * (núcleo 3.x, compilando con -DESP_ARDUINO_VERSION_MAJOR=3).
+ */
+#pragma once
+
+#include "Arduino.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+
+typedef struct {
+  uint32_t timeout_ms;
+  uint32_t idle_core_mask;
+  bool     trigger_panic;
+} esp_task_wdt_config_t;
+
+inline esp_err_t esp_task_wdt_init(uint32_t timeoutS, bool) {
+  sim::wdtArm((uint64_t)timeoutS * 1000000ULL);
+  return ESP_OK;
+}
+inline esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t* config) {
+  sim::wdtArm((uint64_t)config->timeout_ms * 1000ULL);
+  return ESP_OK;
+}
+inline esp_err_t esp_task_wdt_add(void*) { return ESP_OK; }
+inline esp_err_t esp_task_wdt_reset() {
+  sim::wdtKick();
+  return ESP_OK;
+}
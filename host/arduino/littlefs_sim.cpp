@@ -0,0 +1,164 @@
+#include "LittleFS.h"
+
+#include <algorithm>
+
+LittleFSClass LittleFS;
+
+namespace sim {
+
+uint32_t flashOpenUs   = 1000;
+uint32_t flashCloseUs  = 2000;
+uint32_t flashEraseUs  = 40000;
+size_t   flashCapacity = 0x160000;  // partición "spiffs" del esquema por defecto (4 MB)
+
+}  // namespace sim
+
+namespace {
+
+const size_t kBlock = 4096;
+
+std::map<std::string, std::vector<uint8_t>> files;
+std::set<std::string>                       dirs;
+
+size_t blocks(size_t bytes) { return std::max<size_t>(1, (bytes + kBlock - 1) / kBlock); }
+
+std::string parentOf(const std::string& path) {
+  size_t p = path.rfind('/');
+  return (p == 0 || p == std::string::npos) ? std::string("/") : path.substr(0, p);
+}
+
+}  // namespace
+
+size_t sim::flashUsed() {
+  size_t b = 2 + dirs.size();  // superbloques y un bloque de metadatos por directorio
+  for (const auto& f : files) b += blocks(f.second.size());
+  return b * kBlock;
+}
+
+// =======================================================
+// FILE
+// =======================================================
+
+size_t File::write(const uint8_t* b, size_t n) {
+  sim::HeapPause pause;
+  if (!st_ || !st_->writable) return 0;
+  std::vector<uint8_t>& d = files[st_->path];
+
+  size_t end   = std::max(d.size(), st_->pos + n);
+  size_t added = blocks(end) - blocks(d.size());
+  if (sim::flashUsed() + added * kBlock > sim::flashCapacity) return 0;
+  sim::advance((uint64_t)added * sim::flashEraseUs);
+
+  if (d.size() < end) d.resize(end);
+  std::copy(b, b + n, d.begin() + st_->pos);
+  st_->pos += n;
+  st_->written = true;
+  return n;
+}
+
+size_t File::read(uint8_t* b, size_t n) {
+  if (!st_ || st_->dir) return 0;
+  auto it = files.find(st_->path);
+  if (it == files.end() || st_->pos >= it->second.size()) return 0;
+  size_t k = std::min(n, it->second.size() - st_->pos);
+  std::copy(it->second.begin() + st_->pos, it->second.begin() + st_->pos + k, b);
+  st_->pos += k;
+  return k;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::available() { return (int)(size() - position()); }
+
+bool File::seek(uint32_t pos) {
+  if (!st_ || pos > size()) return false;
+  st_->pos = pos;
+  return true;
+}
+
+size_t File::size() const {
+  if (!st_ || st_->dir) return 0;
+  auto it = files.find(st_->path);
+  return it == files.end() ? 0 : it->second.size();
+}
+
+// Como el núcleo 2.x del ESP32: solo el nombre, sin el directorio
+const char* File::name() const {
+  if (!st_) return "";
+  size_t p = st_->path.rfind('/');
+  return st_->path.c_str() + (p == std::string::npos ? 0 : p + 1);
+}
+
+File File::openNextFile() {
+  sim::HeapPause pause;
+  if (!st_ || !st_->dir || st_->next >= st_->entries.size()) return File();
+  return LittleFS.open(st_->entries[st_->next++].c_str(), "r");
+}
+
+void File::close() {
+  sim::HeapPause pause;
+  if (st_ && st_->written) sim::advance(sim::flashCloseUs);
+  st_.reset();
+}
+
+// =======================================================
+// LITTLEFS
+// =======================================================
+
+bool LittleFSClass::begin(bool, const char*, uint8_t, const char*) {
+  sim::HeapPause pause;
+  dirs.insert("/");
+  return true;
+}
+
+bool LittleFSClass::format() {
+  sim::HeapPause pause;
+  files.clear();
+  dirs.clear();
+  dirs.insert("/");
+  return true;
+}
+
+File LittleFSClass::open(const char* path, const char* mode, bool) {
+  sim::HeapPause pause;
+  sim::advance(sim::flashOpenUs);
+  std::string p = path;
+  File        f;
+
+  if (dirs.count(p)) {
+    f.st_       = std::make_shared<File::State>();
+    f.st_->path = p;
+    f.st_->dir  = true;
+    for (const auto& e : files) {
+      if (parentOf(e.first) == p) f.st_->entries.push_back(e.first);
+    }
+    return f;
+  }
+
+  bool found = files.count(p) > 0;
+  if (mode[0] == 'r' && !found) return f;
+  if (mode[0] == 'w') files[p].clear();
+  if (mode[0] == 'a' && !found) files[p];
+
+  f.st_           = std::make_shared<File::State>();
+  f.st_->path     = p;
+  f.st_->writable = (mode[0] != 'r') || (mode[1] == '+');
+  f.st_->pos      = (mode[0] == 'a') ? files[p].size() : 0;
+  return f;
+}
+
+bool LittleFSClass::exists(const char* path) { return files.count(path) || dirs.count(path); }
+
+bool LittleFSClass::mkdir(const char* path) {
+  sim::HeapPause pause;
+  dirs.insert(path);
+  return true;
+}
+
+bool LittleFSClass::remove(const char* path) {
+  sim::advance(sim::flashOpenUs);
+  return files.erase(path) > 0;
+}
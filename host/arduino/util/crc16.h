@@ -0,0 +1,12 @@
+/*
+ * _crc16_update de avr-libc (polinomio 0xA001, reflejado), versión en C.
+ */
+#pragma once
+
+#include <cstdint>
+
+inline uint16_t _crc16_update(uint16_t crc, uint8_t a) {
+  crc ^= a;
+  for (int i = 0; i < 8; i++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+  return crc;
+}
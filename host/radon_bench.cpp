@@ -0,0 +1,781 @@
+/*
+ * radon_bench: banco Monte Carlo del detector de pulsos de los nodos.
+ *
+ * Compila el sketch del nodo sin cambios contra el núcleo simulado de
+ * host/arduino, le inyecta en el ADC trenes de pulsos alfa sintéticos
+ * (Poisson, subida rápida y caída exponencial, ruido, deriva de la línea base
+ * y EMI: ráfagas de espigas, oscilaciones amortiguadas y caídas lentas de la
+ * línea base) y compara los pulsos válidos que cuenta con los inyectados.
+ * El tiempo del Nano avanza con el costo real de cada analogRead() y de cada
+ * byte por Serial/XBee, así que el tiempo muerto de los mensajes cuenta.
+ *
+ *   radon_bench [-a 100,1000,5000] [-H horas] [-r ensayos] [-j procesos] [-s semilla]
+ *               [--nodo 1|2] [--ruido mV] [--deriva mV] [--emi por_hora] [--amp min,max]
+ *               [--guardar ref.csv] [--comparar ref.csv] [--tol 0.02] [--tol-fp 1.0]
+ *               [--max-fp por_hora]
+ *
+ * Cada ensayo corre en su propio proceso (el sketch usa variables globales),
+ * hasta -j a la vez (por defecto, uno por núcleo). Con la misma semilla el
+ * resultado es idéntico, así que --comparar sirve de compuerta de regresión:
+ * termina con código 1 si la eficiencia cae más de --tol o los falsos
+ * positivos suben más de --tol-fp por hora respecto de la referencia.
+ */
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "SoftwareSerial.h"
+#include "avr/wdt.h"
+#include "util/crc16.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// En el AVR long es de 32 bits y en el PC de 64: para que las restas de
+// micros() den la vuelta (cada 71 min) como en el Nano, los sketches se
+// compilan con long = int (los encabezados ya están incluidos).
+#define long int
+namespace nodo1 {
+#include "../Arduino_nano_xbee_node_1.cpp"
+}
+namespace nodo2 {
+#include "../Arduino_nano_xbee_node_2.cpp"
+}
+#undef long
+
+namespace {
+
+// Mismo factor que Xbee_ESP32_base.cpp: 0.43 CPS por Bq/L
+const double kCpsPerBqL = 0.43;
+
+// Aritmética en coma flotante del loop del Nano (sin FPU), aparte del ADC
+const uint32_t kLoopCostUs = 40;
+
+// Un pulso válido corresponde a un alfa si el alfa empezó antes de que el
+// detector cruzara el umbral (más el redondeo de millis()) y a lo sumo un
+// ancho del pulso medido antes (mínimo kMatchMinUs). Así también se acredita
+// la cola de un alfa grande que sigue bajo el umbral al salir del
+// refractario, pero no un alfa cualquiera de los últimos cien milisegundos.
+const uint64_t kMatchMinUs    = 2000;
+const uint64_t kMatchKeepUs   = 200000;  // alfas que se guardan para comparar
+
+const double kAdcLsbV       = 5.0 / 1023.0;
+const double kTwoPi         = 6.283185307179586;
+const double kDriftPeriodUs = 6.0 * 3600e6;  // deriva térmica lenta
+
+// Motivos de rechazo, reconocidos por el texto que imprime el sketch
+enum Reject { kAmpLow, kAmpHigh, kDuration, kSpacing, kMute, kBurstBlock, kRejectCount };
+const char* const kRejectText[kRejectCount] = {
+    "amplitud demasiado baja", "amplitud demasiado alta", "duracion fuera de rango",
+    "muy cercano a pulso valido", "ventana de silencio", "Rafaga detectada"};
+const char* const kRejectName[kRejectCount] = {"amp_baja", "amp_alta", "duracion",
+                                               "espaciado", "silencio", "rafaga"};
+
+#if RADON_PROFILE
+// Histogramas de latencia que el sketch manda por el XBee ("Nodo_1;P=...")
+enum ProfHist { kProfLoop, kProfSampling, kProfTx, kProfCount };
+const char* const kProfName[kProfCount] = {"loop", "muestreo", "tx"};
+const int         kProfBins             = 32;
+#endif
+
+struct Scenario {
+  int      node       = 1;
+  double   hours      = 4.0;
+  int      trials     = 4;
+  uint64_t seed       = 1;
+  double   noiseMv    = 8.0;   // sigma del ruido blanco
+  double   driftMv    = 60.0;  // amplitud de la deriva de la línea base
+  double   emiPerHour = 6.0;   // transitorios de interferencia por hora
+  double   ampMinV    = 0.15;  // amplitud de los alfas (uniforme)
+  double   ampMaxV    = 1.6;
+  double   tauMinMs   = 6.0;   // constante de la caída (uniforme)
+  double   tauMaxMs   = 14.0;
+  double   riseMs     = 1.0;
+  double   baselineV  = 3.0;
+};
+
+struct Result {
+  uint64_t alphas;      // pulsos alfa inyectados
+  uint64_t counted;     // pulsos válidos contados por el nodo
+  uint64_t matched;     // contados que corresponden a un alfa
+  uint64_t emiBursts;   // ráfagas de espigas
+  uint64_t emiRings;    // oscilaciones amortiguadas
+  uint64_t emiSags;     // caídas lentas de la línea base
+  uint64_t samples;     // lecturas del ADC
+  uint64_t rejects[kRejectCount];
+  uint64_t bootUs;      // del arranque a la primera muestra (el mayor)
+  uint64_t wdtTrips;    // pasadas del loop más largas que el watchdog
+  double   hours;       // tiempo simulado
+  double   cpuSeconds;  // tiempo real del proceso
+#if RADON_PROFILE
+  uint64_t profBins[kProfCount][kProfBins];  // casilla k = [2^k, 2^(k+1)) ticks de 0.5 us
+  uint32_t profMaxUs[kProfCount];
+  uint64_t profExcess;                       // pasadas del loop de más de 2 ms
+#endif
+};
+
+// splitmix64: reproducible en cualquier plataforma, a diferencia de <random>
+class Rng {
+ public:
+  explicit Rng(uint64_t seed) : s_(seed), haveNormal_(false), normal_(0) {}
+
+  uint64_t next() {
+    uint64_t z = (s_ += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+  double uniform() { return (double)(next() >> 11) * (1.0 / 9007199254740992.0); }
+  double uniform(double a, double b) { return a + (b - a) * uniform(); }
+  double exponential(double mean) { return -mean * std::log(1.0 - uniform()); }
+  double normal() {
+    if (haveNormal_) {
+      haveNormal_ = false;
+      return normal_;
+    }
+    double u = 1.0 - uniform(), v = uniform();
+    double r = std::sqrt(-2.0 * std::log(u));
+    normal_     = r * std::sin(kTwoPi * v);
+    haveNormal_ = true;
+    return r * std::cos(kTwoPi * v);
+  }
+
+ private:
+  uint64_t s_;
+  bool     haveNormal_;
+  double   normal_;
+};
+
+// Señal de TP3: la línea base baja con cada alfa y vuelve exponencialmente.
+// Los eventos se generan a medida que avanza el tiempo (siempre creciente).
+// Alfas, EMI y ruido salen de generadores separados: el ruido se sortea en
+// cada muestra, así que con uno solo los alfas inyectados dependerían de
+// cuántas muestras toma el sketch. Así dependen solo de la semilla y la
+// duración, y un cambio de temporización del detector no cambia la verdad.
+class Signal {
+ public:
+  struct Alpha {
+    uint64_t t0Us;
+    double   ampV;
+    double   tauUs;
+    bool     matched;
+  };
+
+  Signal(const Scenario& sc, double alphaCps, uint64_t seed)
+      : sc_(sc), alphaRng_(Rng(seed ^ 0x416C666173ULL).next()),  // "Alfas"
+        emiRng_(Rng(seed ^ 0x454D49ULL).next()),                   // "EMI"
+        noiseRng_(Rng(seed ^ 0x527569646FULL).next()),             // "Ruido"
+        alphaMeanUs_(alphaCps > 0 ? 1e6 / alphaCps : 0),
+        emiMeanUs_(sc.emiPerHour > 0 ? 3600e6 / sc.emiPerHour : 0), alphas_(0), bursts_(0), rings_(0),
+        sags_(0) {
+    driftPhase_  = noiseRng_.uniform(0, kTwoPi);
+    nextAlphaUs_ = alphaMeanUs_ > 0 ? (uint64_t)alphaRng_.exponential(alphaMeanUs_) : UINT64_MAX;
+    nextEmiUs_   = emiMeanUs_ > 0 ? (uint64_t)emiRng_.exponential(emiMeanUs_) : UINT64_MAX;
+  }
+
+  int adc(uint64_t us) {
+    while (nextAlphaUs_ <= us) {
+      Alpha a;
+      a.t0Us    = nextAlphaUs_;
+      a.ampV    = alphaRng_.uniform(sc_.ampMinV, sc_.ampMaxV);
+      a.tauUs   = alphaRng_.uniform(sc_.tauMinMs, sc_.tauMaxMs) * 1000.0;
+      a.matched = false;
+      active_.push_back(a);
+      recent_.push_back(a);
+      alphas_++;
+      nextAlphaUs_ += (uint64_t)alphaRng_.exponential(alphaMeanUs_) + 1;
+    }
+    while (nextEmiUs_ <= us) {
+      addEmi(nextEmiUs_);
+      nextEmiUs_ += (uint64_t)emiRng_.exponential(emiMeanUs_) + 1;
+    }
+
+    double v = sc_.baselineV + sc_.driftMv * 1e-3 * std::sin(kTwoPi * us / kDriftPeriodUs + driftPhase_);
+
+    const double riseUs = sc_.riseMs * 1000.0;
+    for (size_t i = 0; i < active_.size(); i++) {
+      double dt = (double)(us - active_[i].t0Us);
+      v -= (dt < riseUs) ? active_[i].ampV * dt / riseUs
+                         : active_[i].ampV * std::exp(-(dt - riseUs) / active_[i].tauUs);
+    }
+    while (!active_.empty() && us - active_.front().t0Us > riseUs + 10.0 * active_.front().tauUs) {
+      active_.pop_front();
+    }
+
+    for (size_t i = 0; i < spikes_.size(); i++) {
+      if (us >= spikes_[i].t0Us && us < spikes_[i].t0Us + spikes_[i].widthUs) v += spikes_[i].ampV;
+    }
+    if (!spikes_.empty() && us >= spikes_.back().t0Us + spikes_.back().widthUs) spikes_.clear();
+
+    for (size_t i = 0; i < waves_.size(); i++) {
+      const Wave& w = waves_[i];
+      if (us < w.t0Us) continue;
+      double dt = (double)(us - w.t0Us);
+      if (w.ring) {
+        v += w.ampV * std::exp(-dt / w.tauUs) * std::sin(kTwoPi * dt / w.periodUs);
+      } else {
+        // Caída con flancos de coseno de periodUs y meseta de tauUs
+        double e = 1.0;
+        if (dt < w.periodUs) {
+          e = 0.5 - 0.5 * std::cos(kTwoPi * 0.5 * dt / w.periodUs);
+        } else if (dt > w.periodUs + w.tauUs) {
+          double r = dt - w.periodUs - w.tauUs;
+          e        = r < w.periodUs ? 0.5 + 0.5 * std::cos(kTwoPi * 0.5 * r / w.periodUs) : 0.0;
+        }
+        v -= w.ampV * e;
+      }
+    }
+    while (!waves_.empty() && us >= waves_.front().endUs) waves_.pop_front();
+
+    v += sc_.noiseMv * 1e-3 * noiseRng_.normal();
+    return (int)std::lround(v / kAdcLsbV);
+  }
+
+  // Busca el alfa que explica un pulso válido que cruzó el umbral en el
+  // milisegundo startMs y duró durMs: el más cercano dentro de la ventana
+  bool match(uint64_t startMs, uint64_t durMs) {
+    const uint64_t startUs = startMs * 1000;
+    const uint64_t hi      = startUs + 999;
+    const uint64_t slack   = std::max(kMatchMinUs, durMs * 1000);
+    const uint64_t lo      = startUs > slack ? startUs - slack : 0;
+    while (!recent_.empty() && recent_.front().t0Us + kMatchKeepUs < startUs) recent_.pop_front();
+    for (size_t i = recent_.size(); i-- > 0;) {
+      Alpha& a = recent_[i];
+      if (a.t0Us > hi) continue;
+      if (a.t0Us < lo) break;
+      if (!a.matched) {
+        a.matched = true;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint64_t alphas() const { return alphas_; }
+  uint64_t bursts() const { return bursts_; }
+  uint64_t rings() const { return rings_; }
+  uint64_t sags() const { return sags_; }
+
+ private:
+  struct Spike {
+    uint64_t t0Us;
+    uint64_t widthUs;
+    double   ampV;
+  };
+
+  // Oscilación amortiguada (ringing de un relé o un motor, 100–300 Hz) o
+  // caída lenta de la línea base (hundimiento de la alimentación). A
+  // diferencia de las espigas, duran milisegundos y pueden pasar la
+  // discriminación por amplitud y duración: son los falsos positivos.
+  struct Wave {
+    uint64_t t0Us;
+    uint64_t endUs;
+    bool     ring;
+    double   ampV;
+    double   periodUs;  // periodo de la oscilación o duración de cada flanco
+    double   tauUs;     // amortiguación o duración de la meseta
+  };
+
+  // Transitorio de EMI: 60 % ráfagas de espigas, 25 % oscilaciones y 15 %
+  // caídas lentas
+  void addEmi(uint64_t t0) {
+    double kind = emiRng_.uniform();
+    if (kind < 0.6) {
+      addBurst(t0);
+      return;
+    }
+    Wave w;
+    w.t0Us = t0;
+    w.ring = kind < 0.85;
+    if (w.ring) {
+      w.ampV     = emiRng_.uniform(0.3, 1.5) * (emiRng_.uniform() < 0.5 ? -1.0 : 1.0);
+      w.periodUs = emiRng_.uniform(3333, 10000);
+      w.tauUs    = emiRng_.uniform(4000, 20000);
+      w.endUs    = t0 + (uint64_t)(8.0 * w.tauUs);
+      rings_++;
+    } else {
+      w.ampV     = emiRng_.uniform(0.2, 1.0);
+      w.periodUs = emiRng_.uniform(1000, 5000);
+      w.tauUs    = emiRng_.uniform(2000, 80000);
+      w.endUs    = t0 + (uint64_t)(2.0 * w.periodUs + w.tauUs);
+      sags_++;
+    }
+    waves_.push_back(w);
+  }
+
+  // Ráfaga de EMI: 3 a 12 espigas cortas, casi todas hacia abajo
+  void addBurst(uint64_t t0) {
+    int      n = 3 + (int)(emiRng_.uniform() * 10);
+    uint64_t t = t0;
+    for (int i = 0; i < n; i++) {
+      Spike s;
+      s.t0Us    = t;
+      s.widthUs = (uint64_t)emiRng_.uniform(100, 800);
+      s.ampV    = emiRng_.uniform(0.3, 1.5) * (emiRng_.uniform() < 0.7 ? -1.0 : 1.0);
+      spikes_.push_back(s);
+      t += s.widthUs + (uint64_t)emiRng_.uniform(200, 1500);
+    }
+    bursts_++;
+  }
+
+  const Scenario&    sc_;
+  Rng                alphaRng_;
+  Rng                emiRng_;
+  Rng                noiseRng_;
+  double             alphaMeanUs_;
+  double             emiMeanUs_;
+  double             driftPhase_;
+  uint64_t           nextAlphaUs_;
+  uint64_t           nextEmiUs_;
+  std::deque<Alpha>  active_;
+  std::deque<Alpha>  recent_;
+  std::vector<Spike> spikes_;
+  std::deque<Wave>   waves_;
+  uint64_t           alphas_;
+  uint64_t           bursts_;
+  uint64_t           rings_;
+  uint64_t           sags_;
+};
+
+// Acceso uniforme a los dos sketches
+struct Detector {
+  void (*setup)();
+  void (*loop)();
+  uint32_t*       validTotal;   // unsigned long del sketch (32 bits)
+  uint32_t*       lastValidMs;  // fin del último pulso válido
+  uint32_t*       pulseStartMs; // inicio del pulso en curso (luego, del refractario)
+  uint32_t*       bootUs;
+  SoftwareSerial* xbee;
+};
+
+Detector detectorFor(int node) {
+  if (node == 2) {
+    return Detector{nodo2::setup, nodo2::loop, &nodo2::pulseCountTotal, &nodo2::lastValidPulseMs,
+                    &nodo2::pulseStartMs, &nodo2::arranqueUs, &nodo2::xbeeSerial};
+  }
+  return Detector{nodo1::setup, nodo1::loop, &nodo1::pulseCountTotal, &nodo1::lastValidPulseMs,
+                  &nodo1::pulseStartMs, &nodo1::arranqueUs, &nodo1::xbeeSerial};
+}
+
+double alphaCps(double bqm3) { return bqm3 * kCpsPerBqL / 1000.0; }
+
+uint64_t mixSeed(uint64_t seed, size_t level, int trial) {
+  Rng r(seed ^ (0xD1B54A32D192ED03ULL * (level + 1)) ^ (0x8CB92BA72F3D8DD7ULL * (uint64_t)(trial + 1)));
+  return r.next();
+}
+
+#if RADON_PROFILE
+// "Nodo_1;P=<nombre>;M=<max_us>;[E=<n>;]H=<k>:<cuenta>,..."
+void addProfileLine(Result& res, const std::string& line) {
+  size_t p = line.find(";P=");
+  if (p == std::string::npos) return;
+  int h = 0;
+  while (h < kProfCount && line.compare(p + 3, std::strlen(kProfName[h]) + 1,
+                                        std::string(kProfName[h]) + ";") != 0) {
+    h++;
+  }
+  if (h == kProfCount) return;
+  size_t m = line.find(";M=", p);
+  if (m != std::string::npos) {
+    uint32_t maxUs = (uint32_t)std::strtoul(line.c_str() + m + 3, NULL, 10);
+    res.profMaxUs[h] = std::max(res.profMaxUs[h], maxUs);
+  }
+  size_t e = line.find(";E=", p);
+  if (e != std::string::npos) res.profExcess += std::strtoul(line.c_str() + e + 3, NULL, 10);
+  size_t b = line.find(";H=", p);
+  if (b == std::string::npos) return;
+  const char* c = line.c_str() + b + 3;
+  while (*c) {
+    char*         end;
+    unsigned long k = std::strtoul(c, &end, 10);
+    if (*end != ':') break;
+    unsigned long n = std::strtoul(end + 1, &end, 10);
+    if (k < (unsigned long)kProfBins) res.profBins[h][k] += n;
+    c = (*end == ',') ? end + 1 : end;
+  }
+}
+#endif
+
+// Un ensayo completo; corre en un proceso hijo recién bifurcado, así que el
+// sketch arranca con sus variables globales en el estado inicial.
+Result runTrial(const Scenario& sc, double bqm3, uint64_t seed) {
+  Result res;
+  std::memset(&res, 0, sizeof(res));
+
+  auto     t0 = std::chrono::steady_clock::now();
+  Detector d  = detectorFor(sc.node);
+  Signal   sig(sc, alphaCps(bqm3), seed);
+
+  sim::reset();
+  sim::adcSource = [&sig](uint8_t, uint64_t us) { return sig.adc(us); };
+
+  std::string line;
+  Serial.output = [&](uint8_t c) {
+    if (c != '\n') {
+      if (line.size() < 128) line.push_back((char)c);
+      return;
+    }
+    for (int k = 0; k < kRejectCount; k++) {
+      if (line.find(kRejectText[k]) != std::string::npos) res.rejects[k]++;
+    }
+    line.clear();
+  };
+#if RADON_PROFILE
+  std::string xline;
+  d.xbee->output = [&](uint8_t c) {
+    if (c != '\n') {
+      if (xline.size() < 256) xline.push_back((char)c);
+      return;
+    }
+    addProfileLine(res, xline);
+    xline.clear();
+  };
+#endif
+
+  d.setup();
+
+  const uint64_t endUs = (uint64_t)(sc.hours * 3600e6);
+  unsigned long  seen  = *d.validTotal;
+  while (sim::nowUs < endUs) {
+    // Al cerrar un pulso el sketch reutiliza pulseStartMs para el
+    // refractario: el inicio es el valor de antes de la pasada
+    uint32_t startMs = *d.pulseStartMs;
+    d.loop();
+    sim::advance(kLoopCostUs);
+    if (*d.validTotal != seen) {
+      seen = *d.validTotal;
+      res.counted++;
+      if (sig.match(startMs, (uint32_t)(*d.lastValidMs - startMs))) res.matched++;
+    }
+  }
+
+  res.alphas     = sig.alphas();
+  res.emiBursts  = sig.bursts();
+  res.emiRings   = sig.rings();
+  res.emiSags    = sig.sags();
+  res.samples    = sim::adcReads;
+  res.bootUs     = *d.bootUs;
+  res.wdtTrips   = sim::wdtTrips;
+  res.hours      = sim::nowUs / 3600e6;
+  res.cpuSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return res;
+}
+
+void add(Result& a, const Result& b) {
+  a.alphas += b.alphas;
+  a.counted += b.counted;
+  a.matched += b.matched;
+  a.emiBursts += b.emiBursts;
+  a.emiRings += b.emiRings;
+  a.emiSags += b.emiSags;
+  a.samples += b.samples;
+  for (int k = 0; k < kRejectCount; k++) a.rejects[k] += b.rejects[k];
+  a.bootUs = std::max(a.bootUs, b.bootUs);
+  a.wdtTrips += b.wdtTrips;
+  a.hours += b.hours;
+  a.cpuSeconds += b.cpuSeconds;
+#if RADON_PROFILE
+  for (int h = 0; h < kProfCount; h++) {
+    for (int k = 0; k < kProfBins; k++) a.profBins[h][k] += b.profBins[h][k];
+    a.profMaxUs[h] = std::max(a.profMaxUs[h], b.profMaxUs[h]);
+  }
+  a.profExcess += b.profExcess;
+#endif
+}
+
+double efficiency(const Result& r) { return r.alphas ? (double)r.matched / r.alphas : 0.0; }
+double falsePerHour(const Result& r) { return r.hours > 0 ? (r.counted - r.matched) / r.hours : 0.0; }
+
+// Ejecuta todos los ensayos con hasta `jobs` procesos a la vez
+bool runAll(const Scenario& sc, const std::vector<double>& levels, int jobs, std::vector<Result>& out) {
+  struct Job {
+    size_t level;
+    int    fd;
+  };
+  out.assign(levels.size(), Result());
+  for (Result& r : out) std::memset(&r, 0, sizeof(r));
+
+  std::map<pid_t, Job> running;
+  size_t total = levels.size() * (size_t)sc.trials, next = 0;
+  bool   ok    = true;
+
+  std::fflush(stdout);
+  while (next < total || !running.empty()) {
+    while (next < total && (int)running.size() < jobs) {
+      size_t level = next / sc.trials;
+      int    trial = (int)(next % sc.trials);
+      int    fds[2];
+      if (pipe(fds) != 0) {
+        std::perror("pipe");
+        return false;
+      }
+      pid_t pid = fork();
+      if (pid < 0) {
+        std::perror("fork");
+        return false;
+      }
+      if (pid == 0) {
+        close(fds[0]);
+        Result r = runTrial(sc, levels[level], mixSeed(sc.seed, level, trial));
+        ssize_t w = write(fds[1], &r, sizeof(r));
+        _exit(w == (ssize_t)sizeof(r) ? 0 : 1);
+      }
+      close(fds[1]);
+      running[pid] = Job{level, fds[0]};
+      next++;
+    }
+
+    int   st  = 0;
+    pid_t pid = wait(&st);
+    if (pid < 0) break;
+    auto it = running.find(pid);
+    if (it == running.end()) continue;
+    Result r;
+    if (read(it->second.fd, &r, sizeof(r)) == (ssize_t)sizeof(r) && WIFEXITED(st) &&
+        WEXITSTATUS(st) == 0) {
+      add(out[it->second.level], r);
+    } else {
+      std::fprintf(stderr, "Ensayo fallido (pid %d)\n", (int)pid);
+      ok = false;
+    }
+    close(it->second.fd);
+    running.erase(it);
+  }
+  return ok;
+}
+
+// Referencia: "# nodo=1 semilla=1 ensayos=4 horas=4" y luego una fila por actividad
+std::string configLine(const Scenario& sc) {
+  char t[200];
+  std::snprintf(t, sizeof(t), "# nodo=%d semilla=%" PRIu64 " ensayos=%d horas=%g ruido=%g deriva=%g emi=%g amp=%g,%g",
+                sc.node, sc.seed, sc.trials, sc.hours, sc.noiseMv, sc.driftMv, sc.emiPerHour, sc.ampMinV,
+                sc.ampMaxV);
+  return t;
+}
+
+bool saveReference(const char* path, const Scenario& sc, const std::vector<double>& levels,
+                   const std::vector<Result>& res) {
+  FILE* f = std::fopen(path, "w");
+  if (!f) return false;
+  std::fprintf(f, "%s\n", configLine(sc).c_str());
+  std::fprintf(f, "bq_m3,alfas,contados,aciertos,horas,eficiencia,fp_h\n");
+  for (size_t i = 0; i < levels.size(); i++) {
+    const Result& r = res[i];
+    std::fprintf(f, "%g,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.3f,%.4f,%.3f\n", levels[i], r.alphas,
+                 r.counted, r.matched, r.hours, efficiency(r), falsePerHour(r));
+  }
+  return std::fclose(f) == 0;
+}
+
+struct RefRow {
+  double eff;
+  double fpPerHour;
+};
+
+bool loadReference(const char* path, std::string& config, std::map<double, RefRow>& rows) {
+  FILE* f = std::fopen(path, "r");
+  if (!f) return false;
+  char buf[256];
+  while (std::fgets(buf, sizeof(buf), f)) {
+    std::string s = buf;
+    while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.pop_back();
+    if (s.empty()) continue;
+    if (s[0] == '#') {
+      config = s;
+      continue;
+    }
+    double bq, hours, eff, fp;
+    unsigned long long a, c, m;
+    if (std::sscanf(s.c_str(), "%lf,%llu,%llu,%llu,%lf,%lf,%lf", &bq, &a, &c, &m, &hours, &eff, &fp) == 7) {
+      rows[bq] = RefRow{eff, fp};
+    }
+  }
+  std::fclose(f);
+  return true;
+}
+
+std::vector<double> parseList(const char* s) {
+  std::vector<double> v;
+  while (*s) {
+    char*  end;
+    double x = std::strtod(s, &end);
+    if (end == s) break;
+    v.push_back(x);
+    s = (*end == ',') ? end + 1 : end;
+  }
+  return v;
+}
+
+void usage() {
+  std::fprintf(stderr,
+               "Uso: radon_bench [-a 100,1000,5000] [-H horas] [-r ensayos] [-j procesos] [-s semilla]\n"
+               "                 [--nodo 1|2] [--ruido mV] [--deriva mV] [--emi por_hora] [--amp min,max]\n"
+               "                 [--guardar ref.csv] [--comparar ref.csv] [--tol 0.02] [--tol-fp 1.0]\n"
+               "                 [--max-fp por_hora]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Scenario            sc;
+  std::vector<double> levels = {100, 1000, 5000, 20000};
+  long                cores  = sysconf(_SC_NPROCESSORS_ONLN);
+  int                 jobs   = cores > 0 ? (int)cores : 1;
+  const char*         save   = NULL;
+  const char*         ref    = NULL;
+  double              tol    = 0.02;
+  double              tolFp  = 1.0;
+  double              maxFp  = -1;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a   = argv[i];
+    bool        has = i + 1 < argc;
+    if (a == "-a" && has) {
+      levels = parseList(argv[++i]);
+    } else if (a == "-H" && has) {
+      sc.hours = std::strtod(argv[++i], NULL);
+    } else if (a == "-r" && has) {
+      sc.trials = std::atoi(argv[++i]);
+    } else if (a == "-j" && has) {
+      jobs = std::atoi(argv[++i]);
+    } else if (a == "-s" && has) {
+      sc.seed = std::strtoull(argv[++i], NULL, 10);
+    } else if (a == "--nodo" && has) {
+      sc.node = std::atoi(argv[++i]);
+    } else if (a == "--ruido" && has) {
+      sc.noiseMv = std::strtod(argv[++i], NULL);
+    } else if (a == "--deriva" && has) {
+      sc.driftMv = std::strtod(argv[++i], NULL);
+    } else if (a == "--emi" && has) {
+      sc.emiPerHour = std::strtod(argv[++i], NULL);
+    } else if (a == "--amp" && has) {
+      std::vector<double> r = parseList(argv[++i]);
+      if (r.size() != 2) {
+        usage();
+        return 2;
+      }
+      sc.ampMinV = r[0];
+      sc.ampMaxV = r[1];
+    } else if (a == "--guardar" && has) {
+      save = argv[++i];
+    } else if (a == "--comparar" && has) {
+      ref = argv[++i];
+    } else if (a == "--tol" && has) {
+      tol = std::strtod(argv[++i], NULL);
+    } else if (a == "--tol-fp" && has) {
+      tolFp = std::strtod(argv[++i], NULL);
+    } else if (a == "--max-fp" && has) {
+      maxFp = std::strtod(argv[++i], NULL);
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (levels.empty() || sc.hours <= 0 || sc.trials < 1 || jobs < 1 || (sc.node != 1 && sc.node != 2)) {
+    usage();
+    return 2;
+  }
+
+  std::printf("Detector: Arduino_nano_xbee_node_%d.cpp, %d ensayos x %g h por actividad, %d procesos\n",
+              sc.node, sc.trials, sc.hours, jobs);
+  std::printf("%s\n\n", configLine(sc).c_str());
+
+  std::vector<Result> res;
+  auto                t0 = std::chrono::steady_clock::now();
+  if (!runAll(sc, levels, jobs, res)) return 1;
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  std::printf("%8s %7s %8s %6s %6s %7s", "Bq/m3", "alfas/h", "alfas", "efic.", "+-", "FP/h");
+  for (int k = 0; k < kRejectCount; k++) std::printf(" %9s", kRejectName[k]);
+  std::printf(" %8s\n", "Mmuest/s");
+
+  Result all;
+  std::memset(&all, 0, sizeof(all));
+  for (size_t i = 0; i < levels.size(); i++) {
+    const Result& r   = res[i];
+    double        eff = efficiency(r);
+    double        err = r.alphas ? std::sqrt(eff * (1 - eff) / r.alphas) : 0;
+    std::printf("%8g %7.0f %8" PRIu64 " %6.3f %6.3f %7.2f", levels[i], alphaCps(levels[i]) * 3600,
+                r.alphas, eff, err, falsePerHour(r));
+    for (int k = 0; k < kRejectCount; k++) std::printf(" %9.1f", r.rejects[k] / r.hours);
+    std::printf(" %8.2f\n", r.cpuSeconds > 0 ? r.samples / r.cpuSeconds / 1e6 : 0.0);
+    add(all, r);
+  }
+  std::printf("(rechazos por hora simulada; Mmuest/s por núcleo)\n\n");
+  std::printf("Muestras: %" PRIu64 " en %.1f s reales = %.1f M/s en total; el Nano muestrea a %.2f kHz\n",
+              all.samples, wall, all.samples / wall / 1e6, all.samples / (all.hours * 3600) / 1e3);
+  std::printf("EMI inyectada en %.0f h simuladas: %" PRIu64 " ráfagas, %" PRIu64 " oscilaciones, %" PRIu64
+              " caídas lentas\n",
+              all.hours, all.emiBursts, all.emiRings, all.emiSags);
+  std::printf("Arranque hasta la primera muestra: %" PRIu64 " us; pasadas más largas que el watchdog: %" PRIu64
+              "\n",
+              all.bootUs, all.wdtTrips);
+#if RADON_PROFILE
+  // Las cuentas del sketch son de 16 bits y se saturan en 65535 por envío
+  std::printf("Latencias del nodo (RADON_PROFILE), pasadas del loop de más de 2 ms: %" PRIu64 "\n",
+              all.profExcess);
+  for (int h = 0; h < kProfCount; h++) {
+    std::printf("  %-8s max %6" PRIu32 " us |", kProfName[h], all.profMaxUs[h]);
+    for (int k = 0; k < kProfBins; k++) {
+      if (all.profBins[h][k]) std::printf(" >=%gus:%" PRIu64, (1UL << k) / 2.0, all.profBins[h][k]);
+    }
+    std::printf("\n");
+  }
+#endif
+
+  int rc = 0;
+  if (save) {
+    if (saveReference(save, sc, levels, res)) {
+      std::printf("Referencia guardada en %s\n", save);
+    } else {
+      std::perror(save);
+      rc = 1;
+    }
+  }
+
+  if (ref) {
+    std::string              config;
+    std::map<double, RefRow> rows;
+    if (!loadReference(ref, config, rows)) {
+      std::perror(ref);
+      return 1;
+    }
+    if (config != configLine(sc)) {
+      std::printf("Aviso: la referencia se generó con otra configuración:\n  %s\n", config.c_str());
+    }
+    for (size_t i = 0; i < levels.size(); i++) {
+      auto it = rows.find(levels[i]);
+      if (it == rows.end()) continue;
+      double eff = efficiency(res[i]), fp = falsePerHour(res[i]);
+      if (eff < it->second.eff - tol) {
+        std::printf("FALLA %g Bq/m3: eficiencia %.4f < %.4f - %.3f\n", levels[i], eff, it->second.eff, tol);
+        rc = 1;
+      }
+      if (fp > it->second.fpPerHour + tolFp) {
+        std::printf("FALLA %g Bq/m3: FP/h %.3f > %.3f + %.3f\n", levels[i], fp, it->second.fpPerHour, tolFp);
+        rc = 1;
+      }
+    }
+  }
+
+  if (maxFp >= 0) {
+    for (size_t i = 0; i < levels.size(); i++) {
+      if (falsePerHour(res[i]) > maxFp) {
+        std::printf("FALLA %g Bq/m3: FP/h %.3f > %.3f\n", levels[i], falsePerHour(res[i]), maxFp);
+        rc = 1;
+      }
+    }
+  }
+
+  if ((ref || maxFp >= 0) && rc == 0) std::printf("Compuerta: OK\n");
+  return rc;
+}
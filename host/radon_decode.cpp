@@ -0,0 +1,241 @@
+/*
+ * radon_decode: lee el enlace de la base (puerto serie o archivo grabado),
+ * separa tramas binarias y texto, y escribe los datos como líneas CSV.
+ *
+ *   radon_decode [-p /dev/ttyUSB0] [-b 115200] [--bin [--sin-eco] [--sin-depuracion]] [--sync N]
+ *                [--no-ack] [-v]
+ *   radon_decode -f grabacion.bin [-v]
+ *
+ * Salida (stdout), una línea por dato:
+ *   REG,<vivo|flash>,seq,unix,uptime_s,arranque,nodo,cuentas,vetadas,Bq_m3
+ *   EVT,t_base_ms,nodo,vetado,nodos_en_grupo
+ *   STA,uptime_s,mensajes,aceptados,vetados,desbordes,ultimo_seq,confirmado,heap,nodos,arranque,
+ *       vetados_por_azar,tardios,tramas_rechazadas,tramas_largas
+ *   LOG,primer_seq,ultimo_seq,uptime_s,arranque,id_log
+ *   WAV,<línea del nodo>
+ *   PRN,<línea de latencias del nodo>
+ *   PRB,<nombre>,<max_us>,<casilla>:<cuenta>;...   (casilla k = [2^k, 2^(k+1)) ciclos)
+ * El texto de depuración va a stderr con -v. --sin-eco y --sin-depuracion
+ * le piden a la base que no mande el eco del XBee o la depuración.
+ */
+#include "radon_upstream.h"
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+namespace {
+
+speed_t baudConst(long baud) {
+  switch (baud) {
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default:     return 0;
+  }
+}
+
+int openSerial(const char* path, long baud) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) return -1;
+
+  struct termios tio;
+  if (tcgetattr(fd, &tio) != 0) {
+    close(fd);
+    return -1;
+  }
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cc[VMIN]  = 1;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, baudConst(baud));
+  cfsetospeed(&tio, baudConst(baud));
+  if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void sendLine(int fd, const std::string& s) {
+  std::string line = s + "\n";
+  if (write(fd, line.data(), line.size()) != (ssize_t)line.size()) {
+    std::fprintf(stderr, "Error al escribir en el puerto serie\n");
+  }
+}
+
+void usage() {
+  std::fprintf(stderr,
+               "Uso: radon_decode [-p puerto] [-b baudios] [--bin [--sin-eco] [--sin-depuracion]]\n"
+               "                  [--sync N] [--no-ack] [-v]\n"
+               "     radon_decode -f archivo [-v]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* port    = "/dev/ttyUSB0";
+  const char* file    = NULL;
+  long        baud    = 115200;
+  bool        bin     = false;
+  std::string mode    = "MODE BIN";
+  bool        ack     = true;
+  bool        verbose = false;
+  long        sync    = -1;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "-p" && i + 1 < argc) {
+      port = argv[++i];
+    } else if (a == "-b" && i + 1 < argc) {
+      baud = std::strtol(argv[++i], NULL, 10);
+    } else if (a == "-f" && i + 1 < argc) {
+      file = argv[++i];
+    } else if (a == "--bin") {
+      bin = true;
+    } else if (a == "--sin-eco") {
+      mode += " SIN_ECO";
+    } else if (a == "--sin-depuracion") {
+      mode += " SIN_DEPURACION";
+    } else if (a == "--sync" && i + 1 < argc) {
+      sync = std::strtol(argv[++i], NULL, 10);
+    } else if (a == "--no-ack") {
+      ack = false;
+    } else if (a == "-v") {
+      verbose = true;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  int  fd       = -1;
+  bool isSerial = (file == NULL);
+  if (isSerial) {
+    if (baudConst(baud) == 0) {
+      std::fprintf(stderr, "Velocidad no soportada: %ld\n", baud);
+      return 2;
+    }
+    fd = openSerial(port, baud);
+  } else {
+    fd = (std::strcmp(file, "-") == 0) ? STDIN_FILENO : open(file, O_RDONLY);
+  }
+  if (fd < 0) {
+    std::perror(isSerial ? port : file);
+    return 1;
+  }
+
+  if (isSerial) {
+    if (sync >= 0) sendLine(fd, "SYNC " + std::to_string(sync) + " " + std::to_string((long)std::time(NULL)));
+    if (bin) sendLine(fd, mode);
+  }
+
+  // Se confirma lo recibido sin huecos, desde el seq del SYNC
+  radon::AckTracker acks(sync);
+  auto sendAck = [&]() {
+    if (isSerial && ack && acks.started()) sendLine(fd, "ACK " + std::to_string(acks.acked()));
+  };
+
+  auto onFrame = [&](uint8_t type, const uint8_t* p, size_t n) {
+    switch (type) {
+      case radon::kFrameRecords:
+      case radon::kFrameReport:
+      case radon::kFrameReportMore: {
+        for (const radon::Record& r : radon::parseRecords(p, n)) {
+          std::printf("REG,%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%u,%u,%" PRIu32 ",%" PRIu32 ",%.3f\n",
+                      type == radon::kFrameRecords ? "flash" : "vivo", r.seq, r.unix_time,
+                      r.uptime_s, r.boot, r.node, r.counts, r.vetoed, r.activity_bq_m3);
+          acks.add(r.seq);
+        }
+        // Un reporte en vivo se confirma entero, con su última parte
+        if (type != radon::kFrameReportMore) sendAck();
+        break;
+      }
+      case radon::kFrameEvents:
+        for (const radon::PulseEvent& e : radon::parseEvents(p, n)) {
+          std::printf("EVT,%" PRIu32 ",%u,%d,%u\n", e.t_base_ms, e.node, e.vetoed ? 1 : 0,
+                      e.nodes_in_group);
+        }
+        break;
+      case radon::kFrameStats: {
+        radon::Stats s;
+        if (radon::parseStats(p, n, s)) {
+          std::printf("STA,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32
+                      ",%" PRIu32 ",%" PRIu32 ",%u,%u,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\n",
+                      s.uptime_s, s.msg_count, s.coinc_accepted, s.coinc_vetoed, s.coinc_overflow,
+                      s.last_seq, s.acked_seq, s.free_heap, s.active_nodes, s.boot, s.coinc_accidental,
+                      s.coinc_late, s.frames_refused, s.frames_oversized);
+        }
+        break;
+      }
+      case radon::kFrameLogState: {
+        radon::LogState l;
+        if (radon::parseLogState(p, n, l)) {
+          std::printf("LOG,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%u,%" PRIu32 "\n", l.first_seq, l.last_seq,
+                      l.uptime_s, l.boot, l.log_id);
+          // Registro nuevo (seq desde 1) o aviso de seq que ya no existen
+          if (l.last_seq < acks.acked()) acks.reset(0);
+          acks.skipTo(l.first_seq);
+          sendAck();
+        }
+        break;
+      }
+      case radon::kFrameWaveform:
+        std::printf("WAV,%.*s\n", (int)n, (const char*)p);
+        break;
+      case radon::kFrameNodeProfile:
+        std::printf("PRN,%.*s\n", (int)n, (const char*)p);
+        break;
+      case radon::kFrameBaseProfile: {
+        radon::BaseProfile b;
+        if (radon::parseBaseProfile(p, n, b) && b.cpu_mhz > 0) {
+          std::printf("PRB,%s,%" PRIu32 ",", radon::baseProfileName(b.id), b.max_cycles / b.cpu_mhz);
+          bool first = true;
+          for (int k = 0; k < 32; k++) {
+            if (b.bins[k] == 0) continue;
+            std::printf("%s%d:%" PRIu32, first ? "" : ";", k, b.bins[k]);
+            first = false;
+          }
+          std::printf("\n");
+        }
+        break;
+      }
+      case radon::kFrameText:
+        if (verbose) std::fprintf(stderr, "%.*s", (int)n, (const char*)p);
+        break;
+      default:
+        break;
+    }
+    std::fflush(stdout);
+  };
+  auto onLine = [&](const std::string& line) {
+    if (verbose) std::fprintf(stderr, "%s\n", line.c_str());
+  };
+
+  radon::StreamDecoder dec(onFrame, onLine);
+  uint8_t  buf[4096];
+  uint64_t bytes = 0;
+  for (;;) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) break;
+    bytes += (uint64_t)n;
+    dec.feed(buf, (size_t)n);
+  }
+
+  std::fprintf(stderr, "Bytes: %" PRIu64 ", tramas: %" PRIu64 ", errores de CRC: %" PRIu64 "\n",
+               bytes, dec.frames(), dec.crcErrors());
+  if (fd != STDIN_FILENO) close(fd);
+  return 0;
+}
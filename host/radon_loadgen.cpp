@@ -0,0 +1,726 @@
+/*
+ * radon_loadgen: prueba de carga de la base con cientos de nodos virtuales.
+ *
+ * Compila Xbee_ESP32_base.cpp sin cambios contra el núcleo simulado de
+ * host/arduino (UART, LittleFS en memoria, heap del ESP32) y le inyecta por
+ * Serial2 el tráfico de N nodos que reportan como los Nano: "Nodo_N;C=;S=;T="
+ * cada periodo con jitter, deriva de reloj, pulsos Poisson, ráfagas de EMI
+ * simultáneas en varios nodos, mensajes corruptos y reinicios por watchdog
+ * (HELLO con el estado restaurado).
+ *
+ * El enlace se modela como en el hardware: cada nodo tarda 1.04 ms por byte
+ * en pasar el mensaje a su XBee, el XBee coordinador guarda los paquetes en
+ * un buffer finito y los entrega a la base por su UART (XBEE_BAUD). El
+ * tiempo de CPU de cada pasada del loop se mide en el PC y se escala al ESP32
+ * con --escala (calibrar con los histogramas de RADON_PROFILE); la escritura
+ * en flash y la salida por USB cuestan lo que en el hardware.
+ *
+ *   radon_loadgen [-n nodos] [-D días | -H horas] [-P periodo_s] [--jitter ms] [--bq Bq/m3]
+ *                 [--emi por_hora] [--corrupcion prob] [--reinicios por_nodo_dia]
+ *                 [--buffer-xbee bytes] [--baud-xbee baudios] [--escala x]
+ *                 [--paso-ms ms] [--texto | [--sin-eco] [--sin-depuracion]] [--informe-h horas]
+ *                 [--vuelta-h horas] [-s semilla]
+ *
+ * Con --vuelta-h el reloj de la base arranca de modo que millis() (32 bits)
+ * da la vuelta a esas horas de simulación, sin esperar 49 días. --sin-eco y
+ * --sin-depuracion apagan esos canales del modo binario, como haría el host.
+ *
+ * Cada --informe-h horas simuladas escribe una fila con mensajes/s sostenidos,
+ * percentiles de latencia (desde que el nodo empieza a transmitir hasta que la
+ * base termina la pasada del loop que procesó el mensaje), pérdidas, uso de
+ * CPU, del enlace XBee y del USB, heap y ocupación de la tabla y de la flash.
+ * Al final, en modo binario, busca la EMI inyectada en los eventos de la base
+ * (0x04): cuánta se vetó y con qué error llegaron sus marcas.
+ */
+#include "Arduino.h"
+#include "LittleFS.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_task_wdt.h"
+#include "radon_upstream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <new>
+#include <queue>
+#include <string>
+#include <vector>
+
+// En el ESP32 long es de 32 bits y en el PC de 64: para que las restas de
+// millis() den la vuelta como en el hardware, el sketch se compila con
+// long = int (los encabezados ya están incluidos y no se ven afectados).
+#define long int
+namespace base {
+#include "../Xbee_ESP32_base.cpp"
+}
+#undef long
+
+// =======================================================
+// HEAP: se cuenta lo que la base asigna (String, etc.)
+// =======================================================
+namespace {
+
+const size_t kAllocHeader = 16;
+size_t       heapPeak     = 0;
+
+}  // namespace
+
+void* operator new(size_t n) {
+  void* p = std::malloc(n + kAllocHeader);
+  if (!p) throw std::bad_alloc();
+  size_t counted = sim::heapCounting ? n : 0;
+  *(size_t*)p    = counted;
+  sim::heapUsed += counted;
+  if (sim::heapUsed > heapPeak) heapPeak = sim::heapUsed;
+  return (char*)p + kAllocHeader;
+}
+
+void operator delete(void* q) noexcept {
+  if (!q) return;
+  void* p = (void*)((uintptr_t)q - kAllocHeader);  // uintptr_t: evita el falso aviso de -Warray-bounds
+  sim::heapUsed -= *(size_t*)p;
+  std::free(p);
+}
+
+void operator delete(void* q, size_t) noexcept { operator delete(q); }
+
+namespace {
+
+const uint32_t kUsPerByte    = 1042;   // UART nodo -> XBee: 9600 baudios, 8N1
+const uint32_t kAirUs        = 4000;   // paquete RF y reintentos típicos
+const uint32_t kBootHelloMs  = 500;    // XBEE_ARRANQUE_MS del nodo tras encender
+const uint32_t kBootSampleUs = 200;    // del arranque a la primera muestra
+const double   kCpsPerBqL    = 0.43;   // mismo factor que la base
+const int      kMaxTimestamps = 16;    // MAX_TS_PULSOS del nodo
+
+struct Config {
+  int      nodes        = 300;
+  double   days         = 1.0;
+  double   periodS      = 60.0;
+  double   jitterMs     = 500.0;
+  double   bqm3         = 300.0;
+  double   emiPerHour   = 10.0;
+  double   corruptProb  = 0.001;
+  double   rebootsPerDay = 0.2;
+  size_t   xbeeBuffer   = 202;     // XBee 802.15.4: buffer de salida serie
+  uint32_t linkBaud     = base::XBEE_BAUD;  // UART XBee coordinador -> base
+  double   cpuScale     = 20.0;    // tiempo de ESP32 por tiempo de PC
+  double   stepMs       = 2.0;     // resolución con el enlace ocupado
+  double   idleStepMs   = 20.0;
+  bool     binary       = true;
+  bool     echo         = true;    // "MODE BIN SIN_ECO" si no
+  bool     debug        = true;    // "MODE BIN SIN_DEPURACION" si no
+  double   reportH      = 1.0;
+  double   wrapH        = -1;      // horas hasta que millis() da la vuelta (< 0: arranca en 0)
+  uint64_t seed         = 1;
+};
+
+class Rng {
+ public:
+  explicit Rng(uint64_t seed) : s_(seed) {}
+  uint64_t next() {
+    uint64_t z = (s_ += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+  double uniform() { return (double)(next() >> 11) * (1.0 / 9007199254740992.0); }
+  double uniform(double a, double b) { return a + (b - a) * uniform(); }
+  double exponential(double mean) { return -mean * std::log(1.0 - uniform()); }
+  int    below(int n) { return (int)(uniform() * n); }
+  unsigned long poisson(double mean) {
+    if (mean > 30) {
+      double g = std::sqrt(-2.0 * std::log(1.0 - uniform())) * std::cos(6.283185307179586 * uniform());
+      double v = std::floor(mean + std::sqrt(mean) * g + 0.5);
+      return v < 0 ? 0 : (unsigned long)v;
+    }
+    double        l = std::exp(-mean), p = 1.0;
+    unsigned long k = 0;
+    while ((p *= uniform()) > l) k++;
+    return k;
+  }
+
+ private:
+  uint64_t s_;
+};
+
+// =======================================================
+// NODOS VIRTUALES
+// =======================================================
+struct VirtualNode {
+  uint16_t              id;
+  double                clockRate;   // ms del nodo por ms real (resonador)
+  uint64_t              bootUs;
+  uint64_t              lastReportUs;
+  bool                  warm;        // reinicio por watchdog: estado restaurado
+  uint64_t              nextRebootUs;
+  std::vector<uint64_t> emiUs;       // pulsos de EMI desde el último reporte
+  std::deque<uint32_t>  emiMs;       // los mismos en millis() de la base, sin su evento aún
+};
+
+enum EventType { kEvHello, kEvReport, kEvReboot };
+
+struct Event {
+  uint64_t  us;
+  int       node;
+  EventType type;
+  bool operator>(const Event& o) const { return us > o.us; }
+};
+
+// Mensaje en camino a la base
+struct Msg {
+  uint64_t    sentUs;      // el nodo empieza a transmitir
+  uint64_t    arriveUs;    // llega completo al XBee coordinador
+  std::string bytes;
+  bool        corrupt;
+  bool        lost;        // perdió bytes en la UART de la base
+  uint64_t    endOffset;   // posición del '\r' en lo recibido por Serial2
+  bool operator>(const Msg& o) const { return arriveUs > o.arriveUs; }
+};
+
+struct Interval {
+  uint64_t generated = 0;
+  uint64_t processed = 0;
+  uint64_t lostXbee  = 0;
+  uint64_t lostUart  = 0;
+  uint64_t corrupt   = 0;
+  uint64_t linkBytes = 0;
+  uint64_t usbBytes  = 0;
+  double   cpuUs     = 0;
+  unsigned long baseMsgs = 0;
+  std::vector<float> latMs;
+};
+
+class LoadGen {
+ public:
+  explicit LoadGen(const Config& c) : cfg_(c), rng_(c.seed) {}
+
+  int run();
+
+ private:
+  void        bootNode(int i, uint64_t us);
+  void        handle(const Event& e);
+  void        send(int i, std::string line, uint64_t us);
+  std::string report(VirtualNode& n, uint64_t us);
+  void        drain(uint64_t until);
+  void        deliver(uint64_t now);
+  void        hostSide();
+  void        matchEmi(const radon::PulseEvent& e);
+  void        printHeader();
+  void        printRow(const Interval& iv, double hours, double spanS, bool total);
+
+  uint64_t nodeMs(const VirtualNode& n, uint64_t us) const { return elapsedMs(n, n.bootUs, us); }
+  uint64_t elapsedMs(const VirtualNode& n, uint64_t fromUs, uint64_t us) const {
+    return (uint64_t)((us - fromUs) / 1000.0 * n.clockRate);
+  }
+
+  Config                                                  cfg_;
+  Rng                                                     rng_;
+  std::vector<VirtualNode>                                nodes_;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+  uint64_t                                                nextEmiUs_ = UINT64_MAX;
+  uint64_t                                                emiPulses_ = 0;
+  uint64_t                                                emiVetoed_ = 0;
+  std::vector<float>                                      emiErrMs_;  // marca de la base - real
+
+  std::priority_queue<Msg, std::vector<Msg>, std::greater<Msg>> air_;
+  std::deque<Msg> xbee_;        // buffer del XBee coordinador
+  size_t          xbeeBytes_ = 0;
+  size_t          frontPos_  = 0;  // bytes del primero ya entregados
+  uint64_t        linkUs_    = 0;  // fin del último byte entregado
+  std::deque<Msg> inBase_;      // entregados, esperando que la base los lea
+
+  std::vector<uint8_t>  upstream_;
+  radon::StreamDecoder* decoder_ = nullptr;
+  uint64_t              frames_  = 0;
+  uint64_t              records_ = 0;
+  radon::AckTracker     acks_{0};  // el host manda "SYNC 0"
+  uint64_t              jsonLines_ = 0;
+  std::string           textLine_;
+
+  Interval iv_, total_;
+};
+
+void LoadGen::bootNode(int i, uint64_t us) {
+  VirtualNode& n = nodes_[i];
+  n.bootUs       = us;
+  n.lastReportUs = us;
+  n.warm         = false;
+  n.emiUs.clear();
+  events_.push(Event{us + kBootHelloMs * 1000ULL, i, kEvHello});
+  events_.push(Event{us + (uint64_t)(cfg_.periodS * 1e6), i, kEvReport});
+}
+
+// Marcas "T=": pulsos Poisson del periodo más los de EMI, como edades en ms
+std::string LoadGen::report(VirtualNode& n, uint64_t us) {
+  double        mean  = cfg_.bqm3 * kCpsPerBqL / 1000.0 * (us - n.lastReportUs) / 1e6;
+  unsigned long count = rng_.poisson(mean);
+
+  std::vector<uint64_t> t(n.emiUs);
+  for (unsigned long k = 0; k < count; k++) {
+    t.push_back(n.lastReportUs + (uint64_t)rng_.uniform(0, (double)(us - n.lastReportUs)));
+  }
+  std::sort(t.begin(), t.end());
+  n.emiUs.clear();
+  n.lastReportUs = us;
+
+  uint64_t s = nodeMs(n, us);
+  char     buf[64];
+  std::snprintf(buf, sizeof(buf), "Nodo_%u;C=%zu;S=%" PRIu64, n.id, t.size(), s);
+  std::string line = buf;
+  for (size_t k = 0; k < t.size() && (int)k < kMaxTimestamps; k++) {
+    std::snprintf(buf, sizeof(buf), "%s%" PRIu64, k == 0 ? ";T=" : ",", elapsedMs(n, t[k], us));
+    line += buf;
+  }
+  return line;
+}
+
+void LoadGen::send(int i, std::string line, uint64_t us) {
+  (void)i;
+  line += "\r\n";
+  Msg m;
+  m.sentUs    = us;
+  m.arriveUs  = us + line.size() * kUsPerByte + kAirUs;
+  m.corrupt   = false;
+  m.lost      = false;
+  m.endOffset = 0;
+
+  if (rng_.uniform() < cfg_.corruptProb) {
+    // Byte cambiado, byte perdido o línea cortada (se pega a la siguiente)
+    size_t p = 1 + (size_t)rng_.below((int)line.size() - 3);
+    switch (rng_.below(3)) {
+      case 0: line[p] = (char)(33 + rng_.below(94)); break;
+      case 1: line.erase(p, 1); break;
+      default: line.resize(p); break;
+    }
+    m.corrupt = true;
+    iv_.corrupt++;
+  }
+  m.bytes = line;
+  air_.push(m);
+  iv_.generated++;
+}
+
+void LoadGen::handle(const Event& e) {
+  VirtualNode& n = nodes_[e.node];
+  switch (e.type) {
+    case kEvHello: {
+      char buf[64];
+      std::snprintf(buf, sizeof(buf), "Nodo_%u;HELLO;R=%s;E=%c;B=%u", n.id, n.warm ? "W" : "P",
+                    n.warm ? 'R' : 'N', kBootSampleUs);
+      send(e.node, buf, e.us);
+      break;
+    }
+    case kEvReport:
+      send(e.node, report(n, e.us), e.us);
+      events_.push(Event{e.us + (uint64_t)(cfg_.periodS * 1e6 + rng_.uniform(-1, 1) * cfg_.jitterMs * 1000),
+                         e.node, kEvReport});
+      break;
+    case kEvReboot:
+      // Reinicio por watchdog: el reloj del nodo vuelve a cero pero el
+      // periodo, los contadores y las marcas siguen (RAM retenida) y el
+      // XBee, que no se apagó, acepta el HELLO enseguida
+      n.bootUs = e.us;
+      n.warm   = true;
+      events_.push(Event{e.us + 1000, e.node, kEvHello});
+      if (cfg_.rebootsPerDay > 0) {
+        events_.push(Event{e.us + (uint64_t)rng_.exponential(86400e6 / cfg_.rebootsPerDay), e.node, kEvReboot});
+      }
+      break;
+  }
+}
+
+// UART del XBee coordinador a la base: entrega bytes hasta el instante dado
+void LoadGen::drain(uint64_t until) {
+  const uint64_t us = 10000000ULL / cfg_.linkBaud;
+  while (!xbee_.empty() && linkUs_ + us <= until) {
+    Msg&    m = xbee_.front();
+    uint8_t c = (uint8_t)m.bytes[frontPos_];
+    linkUs_ += us;
+    iv_.linkBytes++;
+    if (::Serial2.inject(&c, 1) == 0) m.lost = true;
+    if (c == '\r') m.endOffset = ::Serial2.rxAccepted;
+    if (++frontPos_ == m.bytes.size()) {
+      xbeeBytes_ -= m.bytes.size();
+      if (m.lost) {
+        iv_.lostUart++;
+      } else if (!m.corrupt && m.endOffset > 0) {
+        inBase_.push_back(m);
+      }
+      xbee_.pop_front();
+      frontPos_ = 0;
+    }
+  }
+  if (xbee_.empty() && linkUs_ < until) linkUs_ = until;
+}
+
+// XBee coordinador: acepta paquetes completos si caben en su buffer
+void LoadGen::deliver(uint64_t now) {
+  while (!air_.empty() && air_.top().arriveUs <= now) {
+    Msg m = air_.top();
+    air_.pop();
+    drain(m.arriveUs);
+    if (xbeeBytes_ + m.bytes.size() > cfg_.xbeeBuffer) {
+      iv_.lostXbee++;
+      continue;
+    }
+    xbeeBytes_ += m.bytes.size();
+    xbee_.push_back(m);
+  }
+  drain(now);
+}
+
+// Raspberry Pi: decodifica lo que sale por USB y confirma los reportes
+void LoadGen::hostSide() {
+  iv_.usbBytes += upstream_.size();
+  if (cfg_.binary) {
+    decoder_->feed(upstream_.data(), upstream_.size());
+  } else {
+    for (uint8_t c : upstream_) {
+      if (c != '\n') {
+        if (textLine_.size() < 64) textLine_.push_back((char)c);
+        continue;
+      }
+      if (textLine_.compare(0, 10, "RADON_JSON") == 0) jsonLines_++;
+      textLine_.clear();
+    }
+  }
+  upstream_.clear();
+}
+
+// Busca el pulso de EMI inyectado más cercano a un evento de la base: así se
+// ve cuánta EMI se vetó de verdad y con qué error llegan las marcas
+void LoadGen::matchEmi(const radon::PulseEvent& e) {
+  if (e.node == 0 || e.node > nodes_.size()) return;
+  std::deque<uint32_t>& q = nodes_[e.node - 1].emiMs;
+  while (!q.empty() && (int32_t)(e.t_base_ms - q.front()) > 600000) q.pop_front();  // nunca llegó
+  size_t best = q.size();
+  for (size_t k = 0; k < q.size(); k++) {
+    int32_t d = (int32_t)(e.t_base_ms - q[k]);
+    if (d > -500 && d < 500 && (best == q.size() || std::abs(d) < std::abs((int32_t)(e.t_base_ms - q[best])))) {
+      best = k;
+    }
+  }
+  if (best == q.size()) return;
+  emiErrMs_.push_back((float)(int32_t)(e.t_base_ms - q[best]));
+  if (e.vetoed) emiVetoed_++;
+  q.erase(q.begin() + best);
+}
+
+void LoadGen::printHeader() {
+  std::printf("%7s %6s %7s %6s %6s %6s %6s %7s %7s %7s %7s %5s %5s %5s %7s %7s %5s %7s\n", "hora",
+              "msg/s", "gener.", "proc.", "p_xbee", "p_uart", "corr.", "p50ms", "p95ms", "p99ms",
+              "maxms", "cpu%", "xbee%", "usb%", "heap_kB", "pico_kB", "tabla", "flashkB");
+}
+
+std::string hourLabel(double h) {
+  char b[16];
+  std::snprintf(b, sizeof(b), "%.1f", h);
+  return b;
+}
+
+void LoadGen::printRow(const Interval& iv, double hours, double spanS, bool total) {
+  std::vector<float> lat(iv.latMs);
+  auto pct = [&lat](double q) -> double {
+    if (lat.empty()) return 0;
+    size_t k = (size_t)std::min<double>(lat.size() - 1, q * lat.size());
+    std::nth_element(lat.begin(), lat.begin() + k, lat.end());
+    return lat[k];
+  };
+  double p50 = pct(0.50), p95 = pct(0.95), p99 = pct(0.99);
+  double mx  = lat.empty() ? 0 : *std::max_element(lat.begin(), lat.end());
+
+  int table = 0;
+  for (uint16_t i = 0; i < base::MAX_NODOS; i++) {
+    if (base::nodos[i].id != 0) table++;
+  }
+
+  std::printf("%7s %6.2f %7" PRIu64 " %6" PRIu64 " %6" PRIu64 " %6" PRIu64 " %6" PRIu64
+              " %7.1f %7.1f %7.1f %7.1f %5.1f %5.1f %5.1f %7.1f %7.1f %5d %7.0f\n",
+              total ? "total" : hourLabel(hours).c_str(), iv.baseMsgs / spanS,
+              iv.generated, iv.processed, iv.lostXbee, iv.lostUart, iv.corrupt, p50, p95, p99, mx,
+              100.0 * iv.cpuUs / (spanS * 1e6), 100.0 * iv.linkBytes * 10 / cfg_.linkBaud / spanS,
+              100.0 * iv.usbBytes * 10 / 115200 / spanS, sim::heapUsed / 1024.0, heapPeak / 1024.0, table,
+              sim::flashUsed() / 1024.0);
+  std::fflush(stdout);
+}
+
+void addInterval(Interval& a, const Interval& b) {
+  a.generated += b.generated;
+  a.processed += b.processed;
+  a.lostXbee += b.lostXbee;
+  a.lostUart += b.lostUart;
+  a.corrupt += b.corrupt;
+  a.linkBytes += b.linkBytes;
+  a.usbBytes += b.usbBytes;
+  a.cpuUs += b.cpuUs;
+  a.baseMsgs += b.baseMsgs;
+  a.latMs.insert(a.latMs.end(), b.latMs.begin(), b.latMs.end());
+}
+
+int LoadGen::run() {
+  radon::StreamDecoder decoder(
+      [this](uint8_t type, const uint8_t* p, size_t n) {
+        frames_++;
+        radon::LogState l;
+        if (type == radon::kFrameLogState && radon::parseLogState(p, n, l)) {
+          acks_.skipTo(l.first_seq);
+        } else if (type == radon::kFrameReport || type == radon::kFrameReportMore ||
+                   type == radon::kFrameRecords) {
+          std::vector<radon::Record> r = radon::parseRecords(p, n);
+          records_ += r.size();
+          for (const radon::Record& x : r) acks_.add(x.seq);
+          if (type == radon::kFrameReportMore) return;  // se confirma con la última parte
+        } else if (type == radon::kFrameEvents) {
+          for (const radon::PulseEvent& e : radon::parseEvents(p, n)) matchEmi(e);
+          return;
+        } else {
+          return;
+        }
+        // Como el dashboard: el seq más alto recibido sin huecos, aunque no
+        // haya avanzado (así la base ve la trama perdida)
+        std::string ack = "ACK " + std::to_string(acks_.acked()) + "\n";
+        ::Serial.inject((const uint8_t*)ack.data(), ack.size());
+      },
+      nullptr);
+  decoder_ = &decoder;
+
+  sim::reset();
+  if (cfg_.wrapH >= 0) sim::nowUs = (1ULL << 32) * 1000 - (uint64_t)(cfg_.wrapH * 3600e6);
+  ::Serial.output = [this](uint8_t c) { upstream_.push_back(c); };
+
+  const uint64_t bootUs = sim::nowUs;
+  sim::heapCounting = true;
+  base::setup();
+  sim::heapCounting = false;
+  const uint64_t readyUs = sim::nowUs - bootUs;
+  hostSide();
+
+  std::string hello = "SYNC 0 " + std::to_string((long)std::time(NULL)) + "\n";
+  if (cfg_.binary) {
+    hello += "MODE BIN";
+    if (!cfg_.echo) hello += " SIN_ECO";
+    if (!cfg_.debug) hello += " SIN_DEPURACION";
+    hello += "\n";
+  }
+  ::Serial.inject((const uint8_t*)hello.data(), hello.size());
+
+  const uint64_t startUs = sim::nowUs;
+  nodes_.resize(cfg_.nodes);
+  for (int i = 0; i < cfg_.nodes; i++) {
+    VirtualNode& n = nodes_[i];
+    n.id        = (uint16_t)(i + 1);
+    n.clockRate = 1.0 + rng_.uniform(-0.003, 0.003);
+    bootNode(i, startUs + (uint64_t)rng_.uniform(0, cfg_.periodS * 1e6));
+    if (cfg_.rebootsPerDay > 0) {
+      events_.push(Event{startUs + (uint64_t)rng_.exponential(86400e6 / cfg_.rebootsPerDay), i, kEvReboot});
+    }
+  }
+  if (cfg_.emiPerHour > 0) nextEmiUs_ = startUs + (uint64_t)rng_.exponential(3600e6 / cfg_.emiPerHour);
+
+  std::printf("Base: Xbee_ESP32_base.cpp, MAX_NODOS = %u, tabla = %zu B, reporte = %zu B\n",
+              (unsigned)base::MAX_NODOS, sizeof(base::nodos), sizeof(base::reporteActual));
+  std::printf("Carga: %d nodos, periodo %g s, %g Bq/m3, EMI %g/h, corrupción %g, reinicios %g/nodo/día, %s\n\n",
+              cfg_.nodes, cfg_.periodS, cfg_.bqm3, cfg_.emiPerHour, cfg_.corruptProb, cfg_.rebootsPerDay,
+              cfg_.binary ? "modo binario" : "modo texto");
+  if (cfg_.nodes > (int)base::MAX_NODOS) {
+    std::printf("Aviso: más nodos que MAX_NODOS; compilar con -DRADON_MAX_NODOS=%d\n\n", cfg_.nodes);
+  }
+  printHeader();
+
+  const uint64_t endUs     = startUs + (uint64_t)(cfg_.days * 86400e6);
+  const uint64_t reportUs  = (uint64_t)(cfg_.reportH * 3600e6);
+  uint64_t       nextRowUs = startUs + reportUs;
+  uint64_t       rowStart  = startUs;
+  unsigned long  lastMsgs  = base::msgCount;
+  auto           wall0     = std::chrono::steady_clock::now();
+
+  while (sim::nowUs < endUs) {
+    const uint64_t now = sim::nowUs;
+
+    while (!events_.empty() && events_.top().us <= now) {
+      Event e = events_.top();
+      events_.pop();
+      handle(e);
+    }
+    while (nextEmiUs_ <= now) {
+      // Interferencia vista a la vez por 2 a 5 nodos
+      int k = 2 + rng_.below(4);
+      for (int j = 0; j < k; j++) {
+        VirtualNode& n = nodes_[rng_.below(cfg_.nodes)];
+        n.emiUs.push_back(nextEmiUs_);
+        n.emiMs.push_back((uint32_t)(nextEmiUs_ / 1000));
+      }
+      emiPulses_ += k;
+      nextEmiUs_ += (uint64_t)rng_.exponential(3600e6 / cfg_.emiPerHour) + 1;
+    }
+    deliver(now);
+
+    // Una pasada del loop de la base
+    auto h0   = std::chrono::steady_clock::now();
+    sim::heapCounting = true;
+    base::loop();
+    sim::heapCounting = false;
+    double cpuUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - h0).count() *
+                   cfg_.cpuScale;
+    sim::advance((uint64_t)cpuUs);
+    iv_.cpuUs += cpuUs;
+    hostSide();
+
+    while (!inBase_.empty() && inBase_.front().endOffset <= ::Serial2.rxRead) {
+      iv_.latMs.push_back((float)((sim::nowUs - inBase_.front().sentUs) / 1000.0));
+      iv_.processed++;
+      inBase_.pop_front();
+    }
+
+    // Próxima pasada: pronto si hay algo en camino, si no hasta el próximo evento
+    uint64_t next = now + (uint64_t)(cfg_.stepMs * 1000);
+    if (xbee_.empty() && ::Serial2.available() == 0) {
+      uint64_t idle = now + (uint64_t)(cfg_.idleStepMs * 1000);
+      if (!events_.empty()) idle = std::min(idle, events_.top().us);
+      if (!air_.empty()) idle = std::min(idle, air_.top().arriveUs);
+      next = std::max(next, idle);
+    }
+    if (sim::nowUs < next) sim::nowUs = next;
+
+    if (sim::nowUs >= nextRowUs || sim::nowUs >= endUs) {
+      iv_.baseMsgs = base::msgCount - lastMsgs;
+      lastMsgs     = base::msgCount;
+      double span  = (sim::nowUs - rowStart) / 1e6;
+      printRow(iv_, (sim::nowUs - startUs) / 3600e6, span, false);
+      addInterval(total_, iv_);
+      iv_       = Interval();
+      rowStart  = sim::nowUs;
+      nextRowUs += reportUs;
+    }
+  }
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+  double span = (sim::nowUs - startUs) / 1e6;
+  std::printf("\n");
+  printHeader();
+  printRow(total_, span / 3600, span, true);
+
+  // Techo: extrapolación lineal hasta saturar el recurso más ocupado. Es una
+  // cota superior; las colas pierden mensajes bastante antes (ver p_xbee).
+  const char* names[3] = {"CPU", "enlace XBee", "USB"};
+  double      util[3]  = {100.0 * total_.cpuUs / (span * 1e6), 100.0 * total_.linkBytes * 10 / cfg_.linkBaud / span,
+                          100.0 * total_.usbBytes * 10 / 115200 / span};
+  int         busiest  = (int)(std::max_element(util, util + 3) - util);
+  double      rate     = total_.baseMsgs / span;
+  uint64_t    lost     = total_.lostXbee + total_.lostUart;
+
+  std::printf("\nMensajes procesados por la base: %lu (%.2f/s sostenidos)\n", total_.baseMsgs, rate);
+  std::printf("Perdidos: %.2f %% (%" PRIu64 " en el XBee coordinador, %" PRIu64 " en la UART de la base)\n",
+              total_.generated ? 100.0 * lost / total_.generated : 0.0, total_.lostXbee, total_.lostUart);
+  if (util[busiest] > 0) {
+    std::printf("Recurso más ocupado: %s al %.1f %%; techo lineal %.1f mensajes/s (~%.0f nodos a %g s)\n",
+                names[busiest], util[busiest], rate * 100.0 / util[busiest],
+                rate * 100.0 / util[busiest] * cfg_.periodS, cfg_.periodS);
+  }
+  std::printf("Tablas estáticas de la base: %.1f kB (MAX_NODOS = %u)\n",
+              (sizeof(base::nodos) + sizeof(base::reporteActual)) / 1024.0, (unsigned)base::MAX_NODOS);
+  if (cfg_.binary) {
+    std::printf("Raspberry: %" PRIu64 " tramas, %" PRIu64 " errores de CRC, %" PRIu64 " registros horarios\n",
+                frames_, decoder.crcErrors(), records_);
+  } else {
+    std::printf("Raspberry: %" PRIu64 " líneas RADON_JSON\n", jsonLines_);
+  }
+  std::printf("Base: aceptados %lu, vetados %lu (por azar ~%.0f; EMI inyectada %" PRIu64
+              " pulsos), desbordes de cola %lu, tardíos %lu, bytes perdidos en UART %" PRIu64 "\n",
+              (unsigned long)base::coincAceptados, (unsigned long)base::coincVetados, base::coincCasuales,
+              emiPulses_, (unsigned long)base::coincDesbordes, (unsigned long)base::coincTardios,
+              ::Serial2.rxOverflow);
+  if (cfg_.binary && !emiErrMs_.empty()) {
+    std::vector<float> err(emiErrMs_);
+    for (float& x : err) x = std::fabs(x);
+    std::sort(err.begin(), err.end());
+    std::printf("EMI vetada: %" PRIu64 " de %zu pulsos vistos en los eventos; error de su marca |base - real|:"
+                " p50 %.0f ms, p95 %.0f ms\n",
+                emiVetoed_, err.size(), err[err.size() / 2], err[err.size() * 95 / 100]);
+  }
+  std::printf("Arranque de la base: %.1f ms hasta el loop; pasadas más largas que el watchdog: %" PRIu64
+              "; depuración descartada por Serial lleno: %lu B\n",
+              readyUs / 1000.0, sim::wdtTrips, (unsigned long)base::bytesDescartados);
+  std::printf("Tramas rechazadas por Serial lleno: %lu, demasiado largas: %lu\n",
+              (unsigned long)base::tramasRechazadas, (unsigned long)base::tramasGrandes);
+  std::printf("Simulación: %.1f h en %.1f s reales (x%.0f)\n", span / 3600, wall, span / wall);
+  decoder_ = nullptr;
+  return 0;
+}
+
+void usage() {
+  std::fprintf(stderr,
+               "Uso: radon_loadgen [-n nodos] [-D días | -H horas] [-P periodo_s] [--jitter ms] [--bq Bq/m3]\n"
+               "                   [--emi por_hora] [--corrupcion prob] [--reinicios por_nodo_dia]\n"
+               "                   [--buffer-xbee bytes] [--baud-xbee baudios] [--escala x]\n"
+               "                   [--paso-ms ms] [--texto | [--sin-eco] [--sin-depuracion]] [--informe-h horas]\n"
+               "                   [--vuelta-h horas] [-s semilla]\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Config c;
+  for (int i = 1; i < argc; i++) {
+    std::string a   = argv[i];
+    bool        has = i + 1 < argc;
+    if (a == "-n" && has) {
+      c.nodes = std::atoi(argv[++i]);
+    } else if (a == "-D" && has) {
+      c.days = std::strtod(argv[++i], NULL);
+    } else if (a == "-H" && has) {
+      c.days = std::strtod(argv[++i], NULL) / 24;
+    } else if (a == "-P" && has) {
+      c.periodS = std::strtod(argv[++i], NULL);
+    } else if (a == "--jitter" && has) {
+      c.jitterMs = std::strtod(argv[++i], NULL);
+    } else if (a == "--bq" && has) {
+      c.bqm3 = std::strtod(argv[++i], NULL);
+    } else if (a == "--emi" && has) {
+      c.emiPerHour = std::strtod(argv[++i], NULL);
+    } else if (a == "--corrupcion" && has) {
+      c.corruptProb = std::strtod(argv[++i], NULL);
+    } else if (a == "--reinicios" && has) {
+      c.rebootsPerDay = std::strtod(argv[++i], NULL);
+    } else if (a == "--buffer-xbee" && has) {
+      c.xbeeBuffer = (size_t)std::atol(argv[++i]);
+    } else if (a == "--baud-xbee" && has) {
+      c.linkBaud = (uint32_t)std::atol(argv[++i]);
+    } else if (a == "--escala" && has) {
+      c.cpuScale = std::strtod(argv[++i], NULL);
+    } else if (a == "--paso-ms" && has) {
+      c.stepMs = std::strtod(argv[++i], NULL);
+    } else if (a == "--texto") {
+      c.binary = false;
+    } else if (a == "--sin-eco") {
+      c.echo = false;
+    } else if (a == "--sin-depuracion") {
+      c.debug = false;
+    } else if (a == "--informe-h" && has) {
+      c.reportH = std::strtod(argv[++i], NULL);
+    } else if (a == "--vuelta-h" && has) {
+      c.wrapH = std::strtod(argv[++i], NULL);
+    } else if (a == "-s" && has) {
+      c.seed = std::strtoull(argv[++i], NULL, 10);
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (c.nodes < 1 || c.nodes > 65535 || c.days <= 0 || c.periodS < 1 || c.stepMs <= 0 || c.reportH <= 0 ||
+      c.linkBaud < 1200 || c.jitterMs * 2000 >= c.periodS * 1e6 || c.wrapH * 3600e3 >= 4294967296.0) {
+    usage();
+    return 2;
+  }
+
+  LoadGen g(c);
+  return g.run();
+}
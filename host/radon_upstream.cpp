@@ -0,0 +1,190 @@
+#include "radon_upstream.h"
+
+#include <cstring>
+
+namespace radon {
+
+namespace {
+
+const uint8_t kSync0 = 0xA5;
+const uint8_t kSync1 = 0x5A;
+const size_t  kMaxLine = 4096;
+
+uint16_t le16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+uint32_t le32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+float lef32(const uint8_t* p) {
+  uint32_t u = le32(p);
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+}  // namespace
+
+uint16_t crc16(const uint8_t* p, size_t n, uint16_t crc) {
+  while (n--) {
+    crc ^= (uint16_t)(*p++) << 8;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+std::vector<Record> parseRecords(const uint8_t* p, size_t n) {
+  std::vector<Record> out;
+  out.reserve(n / kRecordSize);
+  for (size_t off = 0; off + kRecordSize <= n; off += kRecordSize) {
+    const uint8_t* r = p + off;
+    if (crc16(r, kRecordSize - 2) != le16(r + 30)) continue;
+    Record rec;
+    rec.seq            = le32(r + 0);
+    rec.unix_time      = le32(r + 4);
+    rec.uptime_s       = le32(r + 8);
+    rec.boot           = le16(r + 12);
+    rec.node           = le16(r + 14);
+    rec.counts         = le32(r + 16);
+    rec.vetoed         = le32(r + 20);
+    rec.activity_bq_m3 = lef32(r + 24);
+    rec.window_s       = le16(r + 28);
+    out.push_back(rec);
+  }
+  return out;
+}
+
+std::vector<PulseEvent> parseEvents(const uint8_t* p, size_t n) {
+  std::vector<PulseEvent> out;
+  out.reserve(n / kPulseEventSize);
+  for (size_t off = 0; off + kPulseEventSize <= n; off += kPulseEventSize) {
+    const uint8_t* e = p + off;
+    PulseEvent ev;
+    ev.t_base_ms      = le32(e + 0);
+    ev.node           = le16(e + 4);
+    ev.vetoed         = e[6] != 0;
+    ev.nodes_in_group = e[7];
+    out.push_back(ev);
+  }
+  return out;
+}
+
+bool parseLogState(const uint8_t* p, size_t n, LogState& out) {
+  if (n < kLogStateSize) return false;
+  out.first_seq = le32(p + 0);
+  out.last_seq  = le32(p + 4);
+  out.uptime_s  = le32(p + 8);
+  out.boot      = le16(p + 12);
+  out.log_id    = le32(p + 14);
+  return true;
+}
+
+bool parseStats(const uint8_t* p, size_t n, Stats& out) {
+  if (n < kStatsSize) return false;
+  out.uptime_s       = le32(p + 0);
+  out.msg_count      = le32(p + 4);
+  out.coinc_accepted = le32(p + 8);
+  out.coinc_vetoed   = le32(p + 12);
+  out.coinc_overflow = le32(p + 16);
+  out.last_seq       = le32(p + 20);
+  out.acked_seq      = le32(p + 24);
+  out.free_heap      = le32(p + 28);
+  out.active_nodes   = le16(p + 32);
+  out.boot           = le16(p + 34);
+  out.coinc_accidental = le32(p + 36);
+  out.coinc_late       = le32(p + 40);
+  out.frames_refused   = le32(p + 44);
+  out.frames_oversized = le32(p + 48);
+  return true;
+}
+
+const char* baseProfileName(uint8_t id) {
+  static const char* const kNames[] = {"loop", "parse", "tx", "flash"};
+  return id < 4 ? kNames[id] : "?";
+}
+
+bool parseBaseProfile(const uint8_t* p, size_t n, BaseProfile& out) {
+  if (n < kBaseProfileSize || p[1] != 32) return false;
+  out.id         = p[0];
+  out.cpu_mhz    = le16(p + 2);
+  out.max_cycles = le32(p + 4);
+  for (int k = 0; k < 32; k++) out.bins[k] = le32(p + 8 + 4 * k);
+  return true;
+}
+
+AckTracker::AckTracker(long start) { reset(start); }
+
+void AckTracker::reset(long start) {
+  started_ = start >= 0;
+  acked_   = started_ ? (uint32_t)start : 0;
+  pending_.clear();
+}
+
+void AckTracker::add(uint32_t seq) {
+  if (seq == 0) return;  // registro sin flash
+  if (!started_) {
+    started_ = true;
+    acked_   = seq - 1;
+  }
+  if (seq > acked_) pending_.insert(seq);
+  advance();
+}
+
+void AckTracker::skipTo(uint32_t seq) {
+  if (seq == 0) return;
+  if (!started_ || seq - 1 > acked_) acked_ = seq - 1;
+  started_ = true;
+  advance();
+}
+
+void AckTracker::advance() {
+  while (!pending_.empty() && *pending_.begin() <= acked_ + 1) {
+    if (*pending_.begin() == acked_ + 1) acked_++;
+    pending_.erase(pending_.begin());
+  }
+}
+
+StreamDecoder::StreamDecoder(FrameHandler on_frame, LineHandler on_line)
+    : on_frame_(on_frame), on_line_(on_line), frames_(0), crc_errors_(0) {}
+
+void StreamDecoder::feed(const uint8_t* data, size_t len) {
+  buf_.insert(buf_.end(), data, data + len);
+
+  size_t pos = 0;
+  const size_t size = buf_.size();
+  while (pos < size) {
+    const uint8_t* b = buf_.data() + pos;
+    if (b[0] == kSync0) {
+      if (size - pos < 2) break;  // esperar el segundo byte de sincronía
+      if (b[1] == kSync1) {
+        if (size - pos < 5) break;
+        size_t plen = le16(b + 3);
+        if (plen <= kMaxPayload) {
+          if (size - pos < 7 + plen) break;  // trama incompleta
+          if (crc16(b + 2, plen + 3) == le16(b + 5 + plen)) {
+            frames_++;
+            if (on_frame_) on_frame_(b[2], b + 5, plen);
+            pos += 7 + plen;
+            continue;
+          }
+          crc_errors_++;
+        }
+      }
+    }
+
+    // Byte de texto
+    pos++;
+    if (b[0] == '\n') {
+      while (!text_.empty() && (text_.back() == '\r' || text_.back() == ' ')) text_.pop_back();
+      if (!text_.empty() && on_line_) on_line_(text_);
+      text_.clear();
+    } else if (text_.size() < kMaxLine) {
+      text_.push_back((char)b[0]);
+    }
+  }
+  buf_.erase(buf_.begin(), buf_.begin() + pos);
+}
+
+}  // namespace radon
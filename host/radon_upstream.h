@@ -0,0 +1,158 @@
+/*
+ * Decodificador del enlace base ESP32 -> host (Raspberry Pi / PC).
+ *
+ * La base manda tramas binarias
+ *     A5 5A | tipo | largo (LE16) | datos | CRC-16/CCITT (LE16, sobre tipo..datos)
+ * mezcladas con líneas de texto en modo texto, o solo tramas en modo binario
+ * ("MODE BIN"). Las estructuras son las mismas de Xbee_ESP32_base.cpp
+ * (little-endian, sin relleno).
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace radon {
+
+enum FrameType : uint8_t {
+  kFrameRecords     = 0x01,  // lote de Record (reenvío desde flash)
+  kFrameLogState    = 0x02,  // LogState, respuesta a SYNC
+  kFrameReport      = 0x03,  // reporte horario en vivo (Record)
+  kFrameEvents      = 0x04,  // lote de PulseEvent
+  kFrameStats       = 0x05,  // Stats
+  kFrameWaveform    = 0x06,  // línea "Nodo_X;W=..." de una captura
+  kFrameNodeProfile = 0x07,  // línea "Nodo_X;P=..." de latencias del nodo
+  kFrameBaseProfile = 0x08,  // BaseProfile (base con RADON_PROFILE)
+  kFrameReportMore  = 0x09,  // parte de un reporte en vivo que sigue en otra trama
+  kFrameText        = 0x10,  // texto de depuración
+  kFrameXbeeEcho    = 0x11,  // bytes crudos recibidos del XBee
+};
+
+// RegistroRadon (32 B)
+struct Record {
+  uint32_t seq;
+  uint32_t unix_time;   // 0 = desconocida
+  uint32_t uptime_s;
+  uint16_t boot;
+  uint16_t node;
+  uint32_t counts;
+  uint32_t vetoed;
+  float    activity_bq_m3;
+  uint16_t window_s;
+};
+const size_t kRecordSize = 32;
+
+// EstadoLog (18 B)
+struct LogState {
+  uint32_t first_seq;
+  uint32_t last_seq;
+  uint32_t uptime_s;
+  uint16_t boot;
+  uint32_t log_id;      // cambia cuando los seq vuelven a empezar en 1
+};
+const size_t kLogStateSize = 18;
+
+// EventoPulso (8 B)
+struct PulseEvent {
+  uint32_t t_base_ms;
+  uint16_t node;
+  bool     vetoed;
+  uint8_t  nodes_in_group;
+};
+const size_t kPulseEventSize = 8;
+
+// Estadisticas (52 B)
+struct Stats {
+  uint32_t uptime_s;
+  uint32_t msg_count;
+  uint32_t coinc_accepted;
+  uint32_t coinc_vetoed;
+  uint32_t coinc_overflow;
+  uint32_t last_seq;
+  uint32_t acked_seq;
+  uint32_t free_heap;
+  uint16_t active_nodes;
+  uint16_t boot;
+  uint32_t coinc_accidental;  // vetados esperados por azar
+  uint32_t coinc_late;        // llegaron con su grupo ya decidido
+  uint32_t frames_refused;    // sin sitio en el buffer de Serial de la base
+  uint32_t frames_oversized;  // más largas que el buffer de tramas
+};
+const size_t kStatsSize = 52;
+
+// PerfilBase (136 B): histograma log2 de ciclos, casilla k = [2^k, 2^(k+1))
+struct BaseProfile {
+  uint8_t  id;           // 0 loop, 1 parse, 2 tx, 3 flash
+  uint16_t cpu_mhz;
+  uint32_t max_cycles;
+  uint32_t bins[32];
+};
+const size_t kBaseProfileSize = 136;
+
+const char* baseProfileName(uint8_t id);
+
+uint16_t crc16(const uint8_t* p, size_t n, uint16_t crc = 0xFFFF);
+
+// Decodificación de los datos de una trama. Los registros con CRC propio
+// incorrecto se descartan.
+std::vector<Record>     parseRecords(const uint8_t* p, size_t n);
+std::vector<PulseEvent> parseEvents(const uint8_t* p, size_t n);
+bool parseLogState(const uint8_t* p, size_t n, LogState& out);
+bool parseStats(const uint8_t* p, size_t n, Stats& out);
+bool parseBaseProfile(const uint8_t* p, size_t n, BaseProfile& out);
+
+// Seq que se puede confirmar con "ACK": el más alto recibido sin huecos.
+// Los registros llegan desordenados (reportes en vivo durante el reenvío) y
+// una trama puede perderse; la base reenvía desde lo confirmado.
+class AckTracker {
+ public:
+  // start: último seq ya guardado (el del SYNC); negativo si no se mandó
+  // SYNC, y entonces se empieza por el primer registro que llegue
+  explicit AckTracker(long start = -1);
+
+  void reset(long start);
+  void add(uint32_t seq);
+  // Nada anterior a seq va a llegar (LogState.first_seq)
+  void skipTo(uint32_t seq);
+
+  bool     started() const { return started_; }
+  uint32_t acked() const { return acked_; }
+
+ private:
+  void advance();
+
+  bool               started_;
+  uint32_t           acked_;
+  std::set<uint32_t> pending_;
+};
+
+// Separa tramas y líneas de texto de un flujo de bytes arbitrario.
+// Los bytes se pueden entregar en trozos de cualquier tamaño.
+class StreamDecoder {
+ public:
+  using FrameHandler = std::function<void(uint8_t type, const uint8_t* data, size_t len)>;
+  using LineHandler  = std::function<void(const std::string& line)>;
+
+  StreamDecoder(FrameHandler on_frame, LineHandler on_line);
+
+  void feed(const uint8_t* data, size_t len);
+
+  uint64_t frames() const { return frames_; }
+  uint64_t crcErrors() const { return crc_errors_; }
+
+ private:
+  static const size_t kMaxPayload = 1024;
+
+  FrameHandler         on_frame_;
+  LineHandler          on_line_;
+  std::vector<uint8_t> buf_;
+  std::string          text_;
+  uint64_t             frames_;
+  uint64_t             crc_errors_;
+};
+
+}  // namespace radon
@@ -5,6 +5,7 @@ import glob
 import re
 import serial
 import json
+import struct
 import time
 from collections import deque
 
@@ -44,10 +45,179 @@ print(f"Archivo de figura: {FIG_PATH}")
 # ==========================================================
 SERIAL_PORT = "/dev/ttyUSB0"
 BAUDRATE = 115200
+REOPEN_S = 2.0              # espera entre intentos si el puerto desaparece
 
 ser = serial.Serial(SERIAL_PORT, BAUDRATE, timeout=1)
 print(f"Escuchando en {SERIAL_PORT} a {BAUDRATE} baudios...")
 
+# ==========================================================
+# ALMACENAR Y REENVIAR: SYNC / ACK CON LA BASE
+# ==========================================================
+# La base guarda cada reporte en flash con un número de secuencia. Al
+# arrancar, al reabrir el puerto y cada vez que la base se reinicia le
+# pedimos todo lo posterior al último seq guardado aquí; lo reenvía en
+# tramas binarias A5 5A | tipo | largo | datos | CRC16 que van mezcladas
+# con las líneas de texto del mismo puerto. El seq solo vale junto con el
+# id del registro de la base: si la flash se formatea, vuelve a empezar en 1.
+# Se confirma (ACK) solo el seq más alto recibido sin huecos: si se pierde
+# una trama, la base la reenvía desde ahí.
+STATE_PATH = os.path.join(BASE_DIR, ".ultimo_seq")
+
+FRAME_RECORDS = 0x01
+FRAME_LOG_STATE = 0x02
+FRAME_REPORT = 0x03
+FRAME_EVENTS = 0x04
+FRAME_STATS = 0x05
+FRAME_WAVEFORM = 0x06
+FRAME_NODE_PROFILE = 0x07
+FRAME_BASE_PROFILE = 0x08
+FRAME_REPORT_MORE = 0x09   # parte de un reporte en vivo; cierra una FRAME_REPORT
+FRAME_TEXT = 0x10
+FRAME_XBEE_ECHO = 0x11
+REC_FMT = "<IIIHHIIfHH"     # ver RegistroRadon en Xbee_ESP32_base.cpp
+REC_SIZE = struct.calcsize(REC_FMT)
+STATE_FMT = "<IIIHI"        # EstadoLog
+STATS_FMT = "<IIIIIIIIHHIIII" # Estadisticas
+MAX_PAYLOAD = 1024          # como kMaxPayload en host/radon_upstream.h
+
+# Modo binario: la base manda todo en tramas (texto de depuración incluido).
+# El eco crudo del XBee no se usa aquí: se le pide que no lo mande.
+BINARY_UPSTREAM = True
+UPSTREAM_MODE = "MODE BIN SIN_ECO"
+
+
+def crc16(data, crc=0xFFFF):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def load_last_seq():
+    """Devuelve (último seq, id del registro); id 0 = desconocido."""
+    try:
+        with open(STATE_PATH) as f:
+            fields = f.read().split()
+        return int(fields[0]), int(fields[1]) if len(fields) > 1 else 0
+    except (OSError, ValueError, IndexError):
+        return 0, 0
+
+
+def save_last_seq(seq):
+    tmp = STATE_PATH + ".tmp"
+    with open(tmp, "w") as f:
+        f.write(f"{seq} {log_id}")
+    os.replace(tmp, STATE_PATH)
+
+
+class SerialDemux:
+    """Separa líneas de texto y tramas binarias del puerto serie."""
+
+    def __init__(self, port):
+        self.port = port
+        self.buf = bytearray()
+        self.text = bytearray()   # línea de texto interrumpida por una trama
+
+    def poll(self):
+        n = self.port.in_waiting
+        self.buf += self.port.read(n if n else 1)
+        out = []
+        while self.buf:
+            start = self.buf.find(b"\xA5\x5A")
+            if start < 0 and self.buf.endswith(b"\xA5"):
+                # la lectura cortó entre A5 y 5A: esperar el byte siguiente
+                start = len(self.buf) - 1
+            nl = self.buf.find(b"\n")
+            if start == 0:
+                if len(self.buf) < 5:
+                    break
+                length = self.buf[3] | (self.buf[4] << 8)
+                if length > MAX_PAYLOAD:
+                    # A5 5A casual (eco del XBee): no esperar 64 KB
+                    del self.buf[:1]
+                    continue
+                if len(self.buf) < 7 + length:
+                    break
+                body = bytes(self.buf[2:5 + length])
+                crc = self.buf[5 + length] | (self.buf[6 + length] << 8)
+                if crc16(body) == crc:
+                    out.append(("frame", body[0], body[3:]))
+                    del self.buf[:7 + length]
+                else:
+                    del self.buf[:1]
+                continue
+            end = nl if (nl >= 0 and (start < 0 or nl < start)) else start
+            if end < 0:
+                # sin fin de línea ni trama: guardar y esperar más bytes
+                self.text += self.buf
+                self.buf.clear()
+                break
+            self.text += self.buf[:end]
+            if end == nl:
+                del self.buf[:nl + 1]
+                line = self.text.decode("utf-8", errors="ignore").strip()
+                self.text.clear()
+                out.append(("text", line))
+            else:
+                del self.buf[:end]
+        return out
+
+
+demux = SerialDemux(ser)
+last_seq, log_id = load_last_seq()  # último seq escrito en un CSV sin huecos y su registro
+written = set()                 # seq escritos por encima de last_seq (en vivo durante el reenvío)
+rx_seq = last_seq               # último seq recibido sin huecos (el que se confirma)
+received = set()                # seq recibidos por encima de rx_seq
+base_boot = None                # arranque de la base visto en la última trama
+bf_head = 0                     # último seq que la base tenía al hacer SYNC
+bf_boot = None
+bf_uptime = 0
+bf_host_time = 0.0
+bf_group = []                   # registros del reporte en curso
+bf_last_rx = 0.0
+live_parts = []                 # registros de las partes de un reporte en vivo
+
+text_frame_buf = ""
+
+
+def send_sync():
+    global rx_seq
+    # La base reenvía todo lo posterior a last_seq
+    rx_seq = last_seq
+    received.clear()
+    ser.write(f"SYNC {last_seq} {int(time.time())} {log_id}\n".encode())
+    print(f"SYNC enviado a la base: último seq guardado = {last_seq}")
+    if BINARY_UPSTREAM:
+        ser.write(f"{UPSTREAM_MODE}\n".encode())
+
+
+def reopen_port():
+    """Reabre el puerto tras una desconexión y vuelve a sincronizar."""
+    global ser
+    try:
+        ser.close()
+    except Exception:
+        pass
+    while not stop_requested:
+        try:
+            ser = serial.Serial(SERIAL_PORT, BAUDRATE, timeout=1)
+            break
+        except serial.SerialException:
+            root.update()
+            time.sleep(REOPEN_S)
+    else:
+        return
+    print(f"Puerto {SERIAL_PORT} reabierto.")
+    demux.port = ser
+    demux.buf.clear()
+    demux.text.clear()
+    send_sync()
+
+
+send_sync()
+
 # ==========================================================
 # ESTRUCTURAS PARA EL DASHBOARD
 # ==========================================================
@@ -57,6 +227,74 @@ times = deque(maxlen=MAX_POINTS)
 n1_vals = deque(maxlen=MAX_POINTS)
 n2_vals = deque(maxlen=MAX_POINTS)
 
+# ==========================================================
+# CAPTURAS DE FORMA DE ONDA (RADON_WAVE)
+# ==========================================================
+# "RADON_WAVE Nodo_1;W=<id>;H=<n>,<pre>,<periodo_us>,<V|R>,<amp_mV>,<dur_ms>"
+# seguido de trozos "RADON_WAVE Nodo_1;W=<id>;K=<k>;D=<3 hex por muestra>".
+ADC_LSB = 5.0 / 1023.0
+CAPTURE_TIMEOUT_S = 120     # un trozo perdido deja la captura a medias
+captures = {}
+
+
+def handle_wave_line(raw):
+    body = raw[raw.find("RADON_WAVE") + len("RADON_WAVE"):].strip()
+    fields = body.split(";")
+    if len(fields) < 3 or not fields[1].startswith("W="):
+        return
+    node = fields[0]
+    key = (node, fields[1][2:])
+
+    # Capturas incompletas: se descartan (el id de 8 bits se reutiliza)
+    now = time.time()
+    for old in [k for k, c in captures.items() if now - c["t"] > CAPTURE_TIMEOUT_S]:
+        print(f">>> Captura {old[1]} de {old[0]} incompleta, descartada")
+        del captures[old]
+
+    # Las líneas vienen por radio: una corrupta o cortada descarta el trozo
+    # y la captura en curso, sin detener la adquisición
+    if fields[2].startswith("H="):
+        captures.pop(key, None)
+        try:
+            n, pre, period_us, reason, amp_mv, dur_ms = fields[2][2:].split(",")
+            captures[key] = {"n": int(n), "pre": int(pre), "period_us": int(period_us),
+                             "reason": reason, "amp_mv": amp_mv, "dur_ms": dur_ms,
+                             "chunks": {}, "t": now}
+        except (ValueError, IndexError):
+            print(f">>> Cabecera de captura inválida: {raw}")
+        return
+
+    cap = captures.get(key)
+    if cap is None or len(fields) < 4 or not fields[2].startswith("K="):
+        return
+    try:
+        if not fields[3].startswith("D="):
+            raise ValueError("sin D=")
+        data = fields[3][2:]
+        if len(data) % 3 != 0:
+            raise ValueError("trozo cortado")
+        cap["chunks"][int(fields[2][2:])] = [int(data[i:i + 3], 16)
+                                             for i in range(0, len(data), 3)]
+    except (ValueError, IndexError):
+        print(f">>> Trozo de captura inválido, captura {key[1]} de {node} descartada")
+        del captures[key]
+        return
+
+    samples = [s for k in sorted(cap["chunks"]) for s in cap["chunks"][k]]
+    if len(samples) < cap["n"]:
+        return
+
+    del captures[key]
+    path = os.path.join(BASE_DIR, f"Captura_{RUN_INDEX}_{node}_{key[1]}_{cap['reason']}.csv")
+    with open(path, "w", newline="") as f:
+        f.write(f"# amp_mV={cap['amp_mv']} dur_ms={cap['dur_ms']}\n")
+        f.write("t_ms,adc,voltios\n")
+        for i, s in enumerate(samples[:cap["n"]]):
+            # la muestra pre-1 es la del disparo (t = 0)
+            t_ms = (i - cap["pre"] + 1) * cap["period_us"] / 1000.0
+            f.write(f"{t_ms:.3f},{s},{s * ADC_LSB:.4f}\n")
+    print(f">>> Captura de {node} guardada en: {path}")
+
 # ==========================================================
 # VENTANA DE CONTROL (TKINTER) CON BOTÓN "PARAR MEDICIONES"
 # ==========================================================
@@ -144,7 +382,250 @@ def update_plot():
 # ARCHIVO CSV PARA EXCEL
 # ==========================================================
 log_file = open(CSV_PATH, "w", buffering=1, newline="")
-log_file.write("hora,nodo1_Bq_m3,nodo2_Bq_m3\n")
+log_file.write("hora,nodo1_Bq_m3,nodo2_Bq_m3,nodo1_vetados,nodo2_vetados\n")
+
+def add_row(clock, Cn1, Cn2, V1, V2):
+    times.append(clock)
+    n1_vals.append(Cn1)
+    n2_vals.append(Cn2)
+
+    log_file.write(f"{clock},{Cn1},{Cn2},{V1},{V2}\n")
+
+
+def advance(seq, pending):
+    """Avanza seq por los siguientes que estén en pending."""
+    while seq + 1 in pending:
+        pending.discard(seq + 1)
+        seq += 1
+    return seq
+
+
+def note_received(seqs):
+    global rx_seq
+    received.update(s for s in seqs if s > rx_seq)
+    rx_seq = advance(rx_seq, received)
+
+
+def note_written(seqs):
+    global last_seq
+    written.update(s for s in seqs if s > last_seq)
+    last_seq = advance(last_seq, written)
+    save_last_seq(last_seq)
+
+
+def skip_to(first):
+    """Nada anterior a first va a llegar (borrado o hueco en la flash)."""
+    global rx_seq, last_seq
+    if first - 1 > rx_seq:
+        rx_seq = advance(first - 1, received)
+        received.difference_update([s for s in received if s <= rx_seq])
+    if first - 1 > last_seq:
+        last_seq = advance(first - 1, written)
+        written.difference_update([s for s in written if s <= last_seq])
+
+
+def send_ack():
+    ser.write(f"ACK {rx_seq}\n".encode())
+
+
+def flush_backfill_group():
+    """Escribe el reporte reenviado pendiente (un registro por nodo)."""
+    global bf_group
+    if not bf_group:
+        return
+    group, bf_group = bf_group, []
+    seqs = [r[0] for r in group]
+    top = max(seqs)
+    if all(s <= last_seq or s in written for s in seqs):
+        return   # ya llegó en vivo
+
+    seq, unix_t, uptime, boot = group[0][:4]
+    if unix_t:
+        clock = time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(unix_t))
+    elif boot == bf_boot:
+        t = bf_host_time - (bf_uptime - uptime)
+        clock = time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(t))
+    else:
+        clock = f"arranque_{boot}+{uptime}s"
+
+    vals = {r[4]: (r[7], r[6]) for r in group}
+    Cn1, V1 = vals.get(1, (0.0, 0))
+    Cn2, V2 = vals.get(2, (0.0, 0))
+    print(f">>> Reenviado desde flash (seq {top}): {clock} nodo1={Cn1:.3f} nodo2={Cn2:.3f}")
+    add_row(clock, round(Cn1, 3), round(Cn2, 3), V1, V2)
+    note_written(seqs)
+
+
+def handle_text_line(raw):
+    """Líneas de texto: modo texto de la base o canal de depuración."""
+    if not raw:
+        return
+
+    print(raw)
+
+    # La base se reinició (en modo texto si fue un encendido): reenviar
+    # SYNC y MODE para recuperar lo que guardó mientras tanto
+    if "[ARRANQUE]" in raw:
+        send_sync()
+
+    # Mensajes de handshake resaltados
+    if "HANDSHAKE" in raw and "Nodo_1" in raw:
+        print(">>> Nodo 1 reportado como CONECTADO")
+    if "HANDSHAKE" in raw and "Nodo_2" in raw:
+        print(">>> Nodo 2 reportado como CONECTADO")
+
+    if "RADON_WAVE" in raw:
+        handle_wave_line(raw)
+        return
+
+    if "RADON_JSON" not in raw:
+        return  # no es paquete de datos, solo log/handshake
+
+    json_start = raw.find("{")
+    if json_start < 0:
+        return
+
+    try:
+        data = json.loads(raw[json_start:])
+    except json.JSONDecodeError:
+        print("JSON inválido:", raw)
+        return
+
+    Cn1 = float(data.get("radon_activity_nodo1", 0.0))
+    Cn2 = float(data.get("radon_activity_nodo2", 0.0))
+    # Cuentas vetadas por coincidencia entre nodos (EMI), ya excluidas
+    V1 = int(data.get("vetoed_nodo1", 0))
+    V2 = int(data.get("vetoed_nodo2", 0))
+
+    clock = time.strftime("%Y-%m-%d %H:%M:%S")
+    seq = int(data.get("seq", 0))
+    first = int(data.get("first_seq", seq)) or seq
+    add_live_report(clock, Cn1, Cn2, V1, V2, list(range(first, seq + 1)) if seq else [])
+    if V1 or V2:
+        # Las que se esperaban por azar (alfas reales en grupos casuales)
+        print(f">>> Vetadas esperadas por azar: nodo1~{data.get('accidental_nodo1', 0)}, "
+              f"nodo2~{data.get('accidental_nodo2', 0)}")
+
+
+def add_live_report(clock, Cn1, Cn2, V1, V2, seqs):
+    if V1 or V2:
+        print(f">>> Vetadas por coincidencia: nodo1={V1}, nodo2={V2}")
+    add_row(clock, Cn1, Cn2, V1, V2)
+
+    # Confirmar a la base lo recibido sin huecos (el reporte está en flash
+    # con estos seq); si no llega hasta aquí, la base reenvía lo que falta
+    if seqs:
+        note_written(seqs)
+        note_received(seqs)
+        send_ack()
+
+    update_plot()
+
+
+def handle_frame(kind, payload):
+    global bf_head, bf_boot, bf_uptime, bf_host_time, bf_last_rx, text_frame_buf
+    global last_seq, rx_seq, log_id, base_boot
+    if kind == FRAME_LOG_STATE:
+        first, bf_head, bf_uptime, bf_boot, new_id = struct.unpack(
+            STATE_FMT, payload[:struct.calcsize(STATE_FMT)])
+        bf_host_time = time.time()
+        base_boot = bf_boot
+        # Mismo criterio que la base al recibir el SYNC
+        if (log_id and new_id != log_id) or bf_head < last_seq:
+            print(f">>> Registro nuevo en la base (flash formateada o borrada): "
+                  f"se descarta el seq {last_seq} del anterior")
+            last_seq = rx_seq = 0
+            written.clear()
+            received.clear()
+        log_id = new_id
+        # También llega al saltar un hueco de la flash durante el reenvío
+        skip_to(first)
+        save_last_seq(last_seq)
+        print(f"Base: registros en flash {first}..{bf_head}, pendientes desde {rx_seq + 1}")
+        send_ack()
+        return
+
+    if kind == FRAME_TEXT:
+        text_frame_buf += payload.decode("utf-8", errors="ignore")
+        *lines, text_frame_buf = text_frame_buf.split("\n")
+        for line in lines:
+            handle_text_line(line.strip())
+        return
+
+    if kind == FRAME_NODE_PROFILE:
+        print("[perfil]", payload.decode("ascii", errors="ignore"))
+        return
+
+    if kind == FRAME_BASE_PROFILE:
+        hid, _, mhz, max_cyc = struct.unpack("<BBHI", payload[:8])
+        bins = struct.unpack("<32I", payload[8:8 + 128])
+        names = ("loop", "parse", "tx", "flash")
+        busy = " ".join(f">={(1 << k) // mhz}us:{n}" for k, n in enumerate(bins) if n)
+        print(f"[perfil base] {names[hid] if hid < 4 else hid}: max={max_cyc // mhz} us | {busy}")
+        return
+
+    if kind == FRAME_WAVEFORM:
+        handle_wave_line("RADON_WAVE " + payload.decode("ascii", errors="ignore"))
+        return
+
+    if kind == FRAME_STATS:
+        st = struct.unpack(STATS_FMT, payload[:struct.calcsize(STATS_FMT)])
+        if base_boot is not None and st[9] != base_boot:
+            send_sync()   # la base se reinició sin que viéramos su arranque
+        base_boot = st[9]
+        print(f"[base] uptime={st[0]} s, mensajes={st[1]}, aceptados={st[2]}, "
+              f"vetados={st[3]} (por azar ~{st[10]}), tardíos={st[11]}, "
+              f"nodos activos={st[8]}, heap libre={st[7]} B, "
+              f"tramas rechazadas={st[12]} (largas={st[13]})")
+        return
+
+    if kind in (FRAME_REPORT, FRAME_REPORT_MORE):
+        recs = []
+        for off in range(0, len(payload) - REC_SIZE + 1, REC_SIZE):
+            chunk = payload[off:off + REC_SIZE]
+            rec = struct.unpack(REC_FMT, chunk)
+            if crc16(chunk[:-2]) == rec[-1]:
+                recs.append(rec)
+        # Con más de 16 nodos el reporte llega en varias tramas: se junta
+        # en una sola fila cuando llega la última (FRAME_REPORT)
+        if kind == FRAME_REPORT_MORE:
+            live_parts.extend(recs)
+            return
+        if recs:
+            # Partes de otro reporte (p. ej. perdido a medias) no se mezclan
+            key = (recs[0][2], recs[0][3])
+            recs = [r for r in live_parts if (r[2], r[3]) == key] + recs
+        live_parts.clear()
+        vals = {r[4]: (r[7], r[6]) for r in recs}
+        Cn1, V1 = vals.get(1, (0.0, 0))
+        Cn2, V2 = vals.get(2, (0.0, 0))
+        clock = time.strftime("%Y-%m-%d %H:%M:%S")
+        add_live_report(clock, round(Cn1, 3), round(Cn2, 3), V1, V2, [r[0] for r in recs if r[0]])
+        return
+
+    if kind != FRAME_RECORDS:
+        return
+
+    seqs = []
+    for off in range(0, len(payload) - REC_SIZE + 1, REC_SIZE):
+        chunk = payload[off:off + REC_SIZE]
+        rec = struct.unpack(REC_FMT, chunk)
+        if crc16(chunk[:-2]) != rec[-1]:
+            continue
+        seqs.append(rec[0])
+        if rec[0] <= last_seq or rec[0] in written or any(r[0] == rec[0] for r in bf_group):
+            continue
+        if bf_group and (rec[2], rec[3]) != (bf_group[0][2], bf_group[0][3]):
+            flush_backfill_group()
+        bf_group.append(rec)
+        if rec[0] >= bf_head:
+            flush_backfill_group()
+
+    note_received(seqs)
+    send_ack()
+    bf_last_rx = time.time()
+    update_plot()
+
 
 # ==========================================================
 # LOOP PRINCIPAL
@@ -159,43 +640,22 @@ try:
             stop_requested = True
             break
 
-        raw = ser.readline().decode("utf-8", errors="ignore").strip()
-        if not raw:
-            continue
-
-        print(raw)
-
-        # Mensajes de handshake resaltados
-        if "HANDSHAKE" in raw and "Nodo_1" in raw:
-            print(">>> Nodo 1 reportado como CONECTADO")
-        if "HANDSHAKE" in raw and "Nodo_2" in raw:
-            print(">>> Nodo 2 reportado como CONECTADO")
-
-        if "RADON_JSON" not in raw:
-            continue  # no es paquete de datos, solo log/handshake
-
-        json_start = raw.find("{")
-        if json_start < 0:
-            continue
-
         try:
-            data = json.loads(raw[json_start:])
-        except json.JSONDecodeError:
-            print("JSON inválido:", raw)
+            items = demux.poll()
+        except (serial.SerialException, OSError) as e:
+            print(f"Puerto serie perdido ({e}); reintentando cada {REOPEN_S:.0f} s...")
+            reopen_port()
             continue
 
-        Cn1 = float(data.get("radon_activity_nodo1", 0.0))
-        Cn2 = float(data.get("radon_activity_nodo2", 0.0))
-
-        clock = time.strftime("%Y-%m-%d %H:%M:%S")
-
-        times.append(clock)
-        n1_vals.append(Cn1)
-        n2_vals.append(Cn2)
-
-        log_file.write(f"{clock},{Cn1},{Cn2}\n")
+        for item in items:
+            if item[0] == "frame":
+                handle_frame(item[1], item[2])
+            else:
+                handle_text_line(item[1])
 
-        update_plot()
+        # Último reporte reenviado si la base dejó de mandar tramas
+        if bf_group and time.time() - bf_last_rx > 3.0:
+            flush_backfill_group()
 
 except KeyboardInterrupt:
     print("Saliendo por Ctrl+C...")